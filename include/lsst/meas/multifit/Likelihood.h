@@ -117,6 +117,105 @@ public:
         bool doApplyWeights=true
     ) const = 0;
 
+    /**
+     *  @brief Evaluate the model at several vectors of nonlinear parameters at once.
+     *
+     *  @param[out] modelMatrices  A nPoints x amplitudeDim x dataDim array; modelMatrices[k] is the
+     *                             transpose of the model matrix @f$B@f$ at nonlinear[k] (the same
+     *                             layout as the output of computeModelMatrixDerivatives()).  As with
+     *                             computeModelMatrix(), implementations should not assume anything
+     *                             about its initial values.
+     *  @param[in] nonlinear       A nPoints x nonlinearDim array of nonlinear parameter vectors.
+     *  @param[in] doApplyWeights  If False, do not apply the weights to the model matrices (intended
+     *                             for debugging purposes only).
+     *
+     *  Samplers and numerical derivatives evaluate the model at many points for the same object; this
+     *  lets a Likelihood share its per-call setup (and its pixel data's trip through the cache) across
+     *  all of them.  The default implementation just calls computeModelMatrix() for each point.
+     */
+    virtual void computeModelMatrices(
+        ndarray::Array<Pixel,3,3> const & modelMatrices,
+        ndarray::Array<Scalar const,2,1> const & nonlinear,
+        bool doApplyWeights=true
+    ) const;
+
+    /**
+     *  @brief Evaluate the derivatives of the model matrix with respect to the nonlinear parameters.
+     *
+     *  @param[out] derivatives  A nonlinearDim x amplitudeDim x dataDim array; derivatives[k] is the
+     *                           transpose of @f$\partial B/\partial\theta_k@f$, so each of its rows
+     *                           corresponds to a column of the model matrix.  As with
+     *                           computeModelMatrix(), the caller is responsible for the shape of the
+     *                           array, but implementations should not assume anything about its values.
+     *  @param[in] nonlinear     Vector of nonlinear parameters at which to evaluate the derivatives.
+     *  @param[in] doApplyWeights   If False, do not apply the weights to the derivatives (intended
+     *                              for debugging purposes only).
+     *  @param[in] modelMatrix   The model matrix at nonlinear, as computed by computeModelMatrix()
+     *                           with the same doApplyWeights argument.  Callers that already have it
+     *                           (as optimizers usually do) can pass it to avoid evaluating it again; if
+     *                           empty, it is computed here.
+     *
+     *  The default implementation uses forward differences, evaluating the model at all perturbed
+     *  points (and the unperturbed point, if modelMatrix is empty) with a single call to
+     *  computeModelMatrices(); subclasses that can do better (by computing derivatives analytically,
+     *  or by only reevaluating the parts of the model matrix that depend on each parameter) should
+     *  override it.
+     */
+    virtual void computeModelMatrixDerivatives(
+        ndarray::Array<Pixel,3,3> const & derivatives,
+        ndarray::Array<Scalar const,1,1> const & nonlinear,
+        bool doApplyWeights=true,
+        ndarray::Array<Pixel const,2,-1> const & modelMatrix=ndarray::Array<Pixel const,2,-1>()
+    ) const;
+
+    /**
+     *  @brief Compute the normal equations for the amplitudes at the given nonlinear parameters.
+     *
+     *  @param[in] nonlinear     Vector of nonlinear parameters at which to evaluate the model.
+     *  @param[out] hessian      An amplitudeDim x amplitudeDim matrix, set to @f$B^T B@f$.
+     *  @param[out] gradient     An amplitudeDim vector, set to @f$B^T z@f$.
+     *
+     *  This is all that is needed to solve for or marginalize over the amplitudes, and both are
+     *  accumulated in double precision.  The default implementation calls computeModelMatrix() and
+     *  multiplies the full matrix; subclasses that can evaluate the model matrix a block of rows at a
+     *  time should override it to avoid ever holding the full matrix in memory.
+     */
+    virtual void computeNormalEquations(
+        ndarray::Array<Scalar const,1,1> const & nonlinear,
+        ndarray::Array<Scalar,2,2> const & hessian,
+        ndarray::Array<Scalar,1,1> const & gradient
+    ) const;
+
+    /**
+     *  @brief Compute the normal equations at several vectors of nonlinear parameters at once.
+     *
+     *  @param[in] nonlinear     A nPoints x nonlinearDim array of nonlinear parameter vectors.
+     *  @param[out] hessians     A nPoints x amplitudeDim x amplitudeDim array; hessians[k] is set as
+     *                           by computeNormalEquations() at nonlinear[k].
+     *  @param[out] gradients    A nPoints x amplitudeDim array; gradients[k] is set as by
+     *                           computeNormalEquations() at nonlinear[k].
+     *
+     *  This is to computeNormalEquations() what computeModelMatrices() is to computeModelMatrix().
+     *  The default implementation just calls computeNormalEquations() for each point.
+     */
+    virtual void computeNormalEquationsBatch(
+        ndarray::Array<Scalar const,2,1> const & nonlinear,
+        ndarray::Array<Scalar,3,3> const & hessians,
+        ndarray::Array<Scalar,2,2> const & gradients
+    ) const;
+
+    /**
+     *  @brief Return a new Likelihood that can be used concurrently with this one.
+     *
+     *  The new Likelihood must produce exactly the same results, but must not share any mutable
+     *  workspace with this one, so the two can be evaluated in different threads.  Immutable data
+     *  (such as the data and weight vectors) may be shared.
+     *
+     *  The default implementation returns an empty pointer, indicating that the Likelihood cannot
+     *  be cloned, and hence must only be used from one thread at a time.
+     */
+    virtual PTR(Likelihood) clone() const { return PTR(Likelihood)(); }
+
     virtual ~Likelihood() {}
 
 protected:
@@ -130,6 +229,9 @@ protected:
         );
     }
 
+    /// Return the step size used to compute numerical derivatives of the model matrix w.r.t. a parameter
+    static Scalar computeNumDiffStep(Scalar parameter);
+
     PTR(Model) _model;
     ndarray::Array<Scalar const,1,1> _fixed;
     ndarray::Array<Pixel,1,1> _data;
@@ -24,6 +24,7 @@
 #ifndef LSST_MEAS_MULTIFIT_Mixture_h_INCLUDED
 #define LSST_MEAS_MULTIFIT_Mixture_h_INCLUDED
 
+#include <cmath>
 #include <limits>
 
 #include "Eigen/Cholesky"
@@ -211,6 +212,39 @@ public:
         return p;
     }
 
+    /**
+     *  @brief Evaluate the natural logarithm of a single weighted component at the given point.
+     */
+    template <typename Derived>
+    Scalar evaluateLog(Component const & component, Eigen::MatrixBase<Derived> const & x) const {
+        Scalar z = _computeZ(component, x);
+        return std::log(component.weight / component._sqrtDet) + _evaluateLog(z);
+    }
+
+    /**
+     *  @brief Evaluate the natural logarithm of the mixture PDF at the given point
+     *
+     *  The components are combined with a running log-sum-exp, so this remains accurate far from
+     *  all of the component means, where evaluate() underflows to zero.
+     *
+     *  @param[in] x       point to evaluate, as an Eigen expression, shape=(dim,)
+     */
+    template <typename Derived>
+    Scalar evaluateLog(Eigen::MatrixBase<Derived> const & x) const {
+        Scalar maxLog = -std::numeric_limits<Scalar>::infinity();
+        Scalar sum = 0.0;
+        for (const_iterator i = begin(); i != end(); ++i) {
+            if (i->weight <= 0.0) continue;
+            Scalar q = evaluateLog(*i, x);
+            if (q > maxLog) {
+                sum *= std::exp(maxLog - q);
+                maxLog = q;
+            }
+            sum += std::exp(q - maxLog);
+        }
+        return maxLog + std::log(sum);
+    }
+
     /**
      *  @brief Evaluate the distribution probability density function (PDF) at the given points
      *
@@ -246,6 +280,22 @@ public:
         ndarray::Array<Scalar,2,1> const & hessian
     ) const;
 
+    /**
+     *  @brief Evaluate the derivatives of the log of the distribution at the given point
+     *
+     *  Unlike dividing the results of evaluateDerivatives() by evaluate(), this weights the per-component
+     *  derivatives by their relative contributions in log space, and hence does not underflow in the tails.
+     *
+     *  @param[in]  x         point to evaluate the derivative, with size equal to the number of dimensions
+     *  @param[in]  gradient  1st derivative array to fill
+     *  @param[in]  hessian   2nd derivative array to fill
+     */
+    void evaluateLogDerivatives(
+        ndarray::Array<Scalar const,1,1> const & x,
+        ndarray::Array<Scalar,1,1> const & gradient,
+        ndarray::Array<Scalar,2,1> const & hessian
+    ) const;
+
     /**
      *  @brief Draw random variates from the distribution.
      *
@@ -358,6 +408,8 @@ private:
 
     Scalar _evaluate(Scalar z) const;
 
+    Scalar _evaluateLog(Scalar z) const;
+
     void _stream(std::ostream & os) const;
 
     bool _isGaussian;
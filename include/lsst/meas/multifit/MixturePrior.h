@@ -57,6 +57,23 @@ public:
         ndarray::Array<Scalar,2,1> const & crossHessian
     ) const;
 
+    /// @copydoc Prior::evaluateLog
+    virtual Scalar evaluateLog(
+        ndarray::Array<Scalar const,1,1> const & nonlinear,
+        ndarray::Array<Scalar const,1,1> const & amplitudes
+    ) const;
+
+    /// @copydoc Prior::evaluateLogDerivatives
+    virtual void evaluateLogDerivatives(
+        ndarray::Array<Scalar const,1,1> const & nonlinear,
+        ndarray::Array<Scalar const,1,1> const & amplitudes,
+        ndarray::Array<Scalar,1,1> const & nonlinearGradient,
+        ndarray::Array<Scalar,1,1> const & amplitudeGradient,
+        ndarray::Array<Scalar,2,1> const & nonlinearHessian,
+        ndarray::Array<Scalar,2,1> const & amplitudeHessian,
+        ndarray::Array<Scalar,2,1> const & crossHessian
+    ) const;
+
     /// @copydoc Prior::marginalize
     virtual Scalar marginalize(
         Vector const & gradient, Matrix const & hessian,
@@ -79,6 +79,39 @@ public:
         ndarray::Array<Scalar,2,1> const & crossHessian
     ) const = 0;
 
+    /**
+     *  @brief Evaluate the natural logarithm of the prior at the given point.
+     *
+     *  Returns -infinity where the prior is zero.  The default implementation simply takes the log of
+     *  evaluate(); subclasses should override this when they can compute it directly, which avoids
+     *  underflow far from the mode of the prior.
+     *
+     *  @param[in]   nonlinear        Vector of nonlinear parameters
+     *  @param[in]   amplitudes       Vector of linear parameters
+     */
+    virtual Scalar evaluateLog(
+        ndarray::Array<Scalar const,1,1> const & nonlinear,
+        ndarray::Array<Scalar const,1,1> const & amplitudes
+    ) const;
+
+    /**
+     *  @brief Evaluate the derivatives of the natural logarithm of the prior.
+     *
+     *  Arguments are the same as those of evaluateDerivatives(), but the outputs are derivatives of
+     *  ln P instead of P.  The default implementation computes these from evaluate() and
+     *  evaluateDerivatives(), and like evaluateLog() should be overridden when possible.
+     *  The outputs are undefined where the prior is zero.
+     */
+    virtual void evaluateLogDerivatives(
+        ndarray::Array<Scalar const,1,1> const & nonlinear,
+        ndarray::Array<Scalar const,1,1> const & amplitudes,
+        ndarray::Array<Scalar,1,1> const & nonlinearGradient,
+        ndarray::Array<Scalar,1,1> const & amplitudeGradient,
+        ndarray::Array<Scalar,2,1> const & nonlinearHessian,
+        ndarray::Array<Scalar,2,1> const & amplitudeHessian,
+        ndarray::Array<Scalar,2,1> const & crossHessian
+    ) const;
+
     /**
      *  @brief Return the -log amplitude integral of the prior*likelihood product.
      *
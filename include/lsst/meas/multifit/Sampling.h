@@ -140,6 +140,19 @@ public:
         afw::table::BaseRecord & sample
     ) const = 0;
 
+    /**
+     *  @brief Evaluate the objective at several points at once.
+     *
+     *  This is equivalent to setting values[k] to the result of operator() called with parameters[k]
+     *  and samples[k], but subclasses may override it to share work between points (for instance,
+     *  via Likelihood::computeModelMatrices).  The default implementation just calls operator().
+     */
+    virtual void evaluate(
+        ndarray::Array<Scalar const,2,1> const & parameters,
+        afw::table::BaseCatalog & samples,
+        ndarray::Array<Scalar,1,1> const & values
+    ) const;
+
     virtual ~SamplingObjective() {}
 
 protected:
@@ -147,7 +160,6 @@ protected:
 
     PTR(SamplingInterpreter) _interpreter;
     PTR(Likelihood) _likelihood;
-    ndarray::Array<Pixel,2,-1> _modelMatrix;
 };
 
 /**
@@ -24,6 +24,8 @@
 #ifndef LSST_MEAS_MULTIFIT_UnitSystem_h_INCLUDED
 #define LSST_MEAS_MULTIFIT_UnitSystem_h_INCLUDED
 
+#include <map>
+
 #include "lsst/afw/image/Exposure.h"
 #include "lsst/afw/image/Wcs.h"
 #include "lsst/afw/image/Calib.h"
@@ -86,6 +88,69 @@ struct LocalUnitTransform {
         UnitSystem const & destination
     );
 
+    /// Construct from an already-computed geometric transform and flux scaling
+    LocalUnitTransform(afw::geom::AffineTransform const & geometric_, double flux_) :
+        geometric(geometric_), flux(flux_), sb(flux / geometric.getLinear().computeDeterminant())
+    {}
+
+};
+
+/**
+ *  @brief A cache of Wcs linearizations for one UnitSystem (typically that of an Exposure), used to
+ *         build LocalUnitTransforms between it and many other UnitSystems.
+ *
+ *  Constructing a LocalUnitTransform directly requires several full round-trips through both Wcss,
+ *  which can be expensive for the distorted Wcss of real exposures, and is repeated for every object
+ *  fit to the same exposure.  LocalUnitTransformCache splits each transform into a linearization of the
+ *  cached system, which it evaluates once per cell of a coarse grid of pixels and reuses for all positions
+ *  in that cell, and a linearization of the other system, which is always evaluated exactly.  The
+ *  translation part of the result is always exact (the position maps to the same pixel in both
+ *  systems); only the Jacobian is approximate, with an error set by how much the cached Wcs's Jacobian
+ *  varies over one grid cell.
+ *
+ *  If the two Wcss do not use the same celestial coordinate system, the transform is computed exactly
+ *  (and nothing is cached).  The cache is not thread-safe.
+ */
+class LocalUnitTransformCache {
+public:
+
+    /**
+     *  @brief Construct an empty cache.
+     *
+     *  @param[in] system       UnitSystem whose Wcs linearizations should be cached.
+     *  @param[in] gridSpacing  Size (in pixels of the cached system) of the grid cells that share a
+     *                          linearization.  If <= 0, linearizations are computed exactly at each
+     *                          position and never cached.
+     */
+    explicit LocalUnitTransformCache(UnitSystem const & system, double gridSpacing=64.0);
+
+    /// Return a transform from the cached system to the given destination system, at the given position
+    LocalUnitTransform toSystem(
+        afw::coord::Coord const & position,
+        UnitSystem const & destination
+    ) const;
+
+    /// Return a transform from the given source system to the cached system, at the given position
+    LocalUnitTransform fromSystem(
+        afw::coord::Coord const & position,
+        UnitSystem const & source
+    ) const;
+
+    /// Return the cached UnitSystem
+    UnitSystem const & getSystem() const { return _system; }
+
+    /// Return the number of grid cells with a cached linearization
+    int getSize() const { return _linearizations.size(); }
+
+private:
+
+    // Return the linearization of the cached system's pixel-to-sky transform (in degrees) near the
+    // given pixel position.
+    afw::geom::LinearTransform _getLinearization(afw::geom::Point2D const & pixel) const;
+
+    UnitSystem _system;
+    double _gridSpacing;
+    mutable std::map<std::pair<int,int>,afw::geom::LinearTransform> _linearizations;
 };
 
 }}} // namespace lsst::meas::multifit
@@ -24,6 +24,7 @@
 #ifndef LSST_MEAS_MULTIFIT_UnitTransformedLikelihood_h_INCLUDED
 #define LSST_MEAS_MULTIFIT_UnitTransformedLikelihood_h_INCLUDED
 
+#include <string>
 #include <vector>
 #include "boost/scoped_ptr.hpp"
 
@@ -53,7 +54,41 @@ public:
     LSST_CONTROL_FIELD(usePixelWeights, bool,
                        "whether to individually weigh pixels using the variance image.");
 
-    UnitTransformedLikelihoodControl() : usePixelWeights(true) {}
+    LSST_CONTROL_FIELD(nThreads, int,
+                       "number of threads used to evaluate the model matrix; epochs (and chunks of large "
+                       "epochs) are distributed over the threads");
+
+    LSST_CONTROL_FIELD(maxChunkPixels, int,
+                       "if > 0, split epochs with more pixels than this into chunks of roughly equal size "
+                       "that can be evaluated by different threads");
+
+    LSST_CONTROL_FIELD(badMaskPlanes, std::vector<std::string>,
+                       "mask planes that indicate pixels to drop from the fit; if any are given, pixels with "
+                       "non-finite values or non-positive variance are dropped as well");
+
+    LSST_CONTROL_FIELD(truncationTolerance, double,
+                       "if > 0, split multi-Gaussian bases into their components, and skip evaluating a "
+                       "component on any chunk of pixels where its PSF-convolved profile is everywhere "
+                       "below this fraction of its peak (approximately); epochs are split into chunks of "
+                       "at most a few hundred pixels for this, whatever the value of maxChunkPixels");
+
+    LSST_CONTROL_FIELD(superpixelSize, int,
+                       "if >= 2, replace each fully-populated superpixelSize x superpixelSize block of "
+                       "footprint pixels with low signal-to-noise by a single superpixel holding their mean, "
+                       "whose model is evaluated at its center with a correspondingly broadened PSF");
+
+    LSST_CONTROL_FIELD(superpixelMaxSignalToNoise, double,
+                       "blocks of pixels are only combined into superpixels if the absolute value of their "
+                       "summed flux is less than this many times its uncertainty");
+
+    LSST_CONTROL_FIELD(keepUnbinnedPixels, bool,
+                       "whether to keep a copy of the original pixels after setup, so the likelihood can be "
+                       "downsampled later (as required by CoarseToFineTask)");
+
+    UnitTransformedLikelihoodControl() :
+        usePixelWeights(true), nThreads(1), maxChunkPixels(0), truncationTolerance(0.0),
+        superpixelSize(0), superpixelMaxSignalToNoise(3.0), keepUnbinnedPixels(false)
+    {}
 
 };
 
@@ -70,16 +105,20 @@ public:
      * @param[in] footprint     Footprint of source (galaxy) on calexp
      * @param[in] exposure      Subregion of calexp that includes footprint
      * @param[in] psf           Multi-shapelet representation of exposure PSF evaluated at location of galaxy
+     * @param[in] transformCache  Optional cache of Wcs linearizations for the exposure, shared by all
+     *                            objects fit to it; the transform is computed exactly if null.
      */
     explicit EpochFootprint(
         afw::detection::Footprint const &footprint,
         afw::image::Exposure<Pixel> const &exposure,
-        shapelet::MultiShapeletFunction const &psf
+        shapelet::MultiShapeletFunction const &psf,
+        PTR(LocalUnitTransformCache) transformCache=PTR(LocalUnitTransformCache)()
     );
 
     afw::detection::Footprint const footprint;  ///< footprint of source (galaxy)
     afw::image::Exposure<Pixel> const exposure; ///< subregion of exposure that includes footprint
     shapelet::MultiShapeletFunction const psf;   ///< multi-shapelet model of exposure PSF
+    PTR(LocalUnitTransformCache) const transformCache; ///< Wcs linearization cache for exposure (may be null)
 };
 
 /**
@@ -104,6 +143,67 @@ public:
         bool doApplyWeights=true
     ) const;
 
+    /**
+     *  @brief Evaluate the model at several vectors of nonlinear parameters at once.
+     *
+     *  This overrides the default implementation to evaluate all points for each epoch (or chunk)
+     *  together, so each chunk's pixel positions and workspace are loaded once per batch instead of
+     *  once per point, and a single parallel loop is used for the whole batch.
+     *
+     *  @copydetails Likelihood::computeModelMatrices
+     */
+    virtual void computeModelMatrices(
+        ndarray::Array<Pixel,3,3> const & modelMatrices,
+        ndarray::Array<Scalar const,2,1> const & nonlinear,
+        bool doApplyWeights=true
+    ) const;
+
+    /**
+     *  @brief Evaluate the derivatives of the model matrix with respect to the nonlinear parameters.
+     *
+     *  This overrides the default implementation to only reevaluate the blocks of the model matrix
+     *  that correspond to ellipses that actually depend on each nonlinear parameter; all other
+     *  blocks are exactly zero.  The remaining blocks are still computed with forward differences.
+     *
+     *  @copydetails Likelihood::computeModelMatrixDerivatives
+     */
+    virtual void computeModelMatrixDerivatives(
+        ndarray::Array<Pixel,3,3> const & derivatives,
+        ndarray::Array<Scalar const,1,1> const & nonlinear,
+        bool doApplyWeights=true,
+        ndarray::Array<Pixel const,2,-1> const & modelMatrix=ndarray::Array<Pixel const,2,-1>()
+    ) const;
+
+    /**
+     *  @brief Compute the normal equations for the amplitudes at the given nonlinear parameters.
+     *
+     *  This overrides the default implementation to evaluate the model matrix in tiles of a few hundred
+     *  rows (independent of UnitTransformedLikelihoodControl::maxChunkPixels), accumulating each tile's
+     *  contribution immediately, so the full model matrix is never held in memory.
+     *
+     *  @copydetails Likelihood::computeNormalEquations
+     */
+    virtual void computeNormalEquations(
+        ndarray::Array<Scalar const,1,1> const & nonlinear,
+        ndarray::Array<Scalar,2,2> const & hessian,
+        ndarray::Array<Scalar,1,1> const & gradient
+    ) const;
+
+    /**
+     *  @brief Compute the normal equations at several vectors of nonlinear parameters at once.
+     *
+     *  This overrides the default implementation to evaluate all points for each tile together (as
+     *  computeModelMatrices() does for each chunk), so each tile's pixel positions and workspace are
+     *  loaded once per batch, while still only holding one tile of the model matrix per thread.
+     *
+     *  @copydetails Likelihood::computeNormalEquationsBatch
+     */
+    virtual void computeNormalEquationsBatch(
+        ndarray::Array<Scalar const,2,1> const & nonlinear,
+        ndarray::Array<Scalar,3,3> const & hessians,
+        ndarray::Array<Scalar,2,2> const & gradients
+    ) const;
+
     /**
      * @brief Initialize a UnitTransformedLikelihood with data from multiple exposures.
      *
@@ -134,6 +234,8 @@ public:
      * @param[in] footprint         Footprint that defines the pixels to include in the fit
      * @param[in] psf               Shapelet approximation to the PSF
      * @param[in] ctrl              Control object with various options
+     * @param[in] transformCache    Optional cache of Wcs linearizations for the exposure, shared by all
+     *                              objects fit to it; the transform is computed exactly if null.
      */
     explicit UnitTransformedLikelihood(
         PTR(Model) model,
@@ -143,13 +245,43 @@ public:
         afw::image::Exposure<Pixel> const & exposure,
         afw::detection::Footprint const & footprint,
         shapelet::MultiShapeletFunction const & psf,
-        UnitTransformedLikelihoodControl const & ctrl
+        UnitTransformedLikelihoodControl const & ctrl,
+        PTR(LocalUnitTransformCache) transformCache=PTR(LocalUnitTransformCache)()
     );
 
+    /**
+     * @brief Initialize a downsampled version of another UnitTransformedLikelihood.
+     *
+     * The pixels of each exposure are averaged in binFactor x binFactor blocks (any superpixels
+     * configured for the original are not used), and the PSF is broadened to approximate the
+     * averaging of the model over each block.  This is intended for a fast, approximate fit that
+     * can be used as the starting point for a fit to the original.
+     *
+     * @param[in] other             Likelihood to downsample; its data, model, and control options
+     *                              are reused.  It must have been constructed with
+     *                              keepUnbinnedPixels=true (see canDownsample()).
+     * @param[in] binFactor         Number of pixels on a side of each block; 1 for no binning.
+     */
+    UnitTransformedLikelihood(UnitTransformedLikelihood const & other, int binFactor);
+
+    /// Return true if this likelihood kept the original pixels, and hence can be downsampled.
+    bool canDownsample() const;
+
+    /// @copydoc Likelihood::clone
+    virtual PTR(Likelihood) clone() const;
+
     virtual ~UnitTransformedLikelihood();
 
 private:
+
+    // Copy constructor used by clone(); shares data and weights, but not workspace.
+    UnitTransformedLikelihood(UnitTransformedLikelihood const & other);
+
     class Impl;
+
+    // Create the implementation object for the given Model and control object; used by the constructors.
+    static Impl * makeImpl(PTR(Model) model, UnitTransformedLikelihoodControl const & ctrl);
+
     boost::scoped_ptr<Impl> _impl;
 };
 
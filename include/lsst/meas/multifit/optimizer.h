@@ -37,6 +37,7 @@ namespace lsst { namespace meas { namespace multifit {
 class Likelihood;
 class Prior;
 class Optimizer;
+class ParallelForPool;
 
 /**
  *  @brief Interpreter class for fitting using a greedy optimizer.
@@ -111,6 +112,26 @@ protected:
 
 };
 
+/**
+ *  @brief Memory that can be reused by the objectives of a sequence of optimizer runs.
+ *
+ *  Objectives created with a workspace take their largest buffers from it instead of allocating
+ *  them, and the workspace only reallocates when a larger buffer is needed than any requested
+ *  before.  Because the buffers are shared, only one objective created with a given workspace
+ *  may be used at a time; creating a new one invalidates the previous one.
+ */
+class OptimizerWorkspace {
+public:
+
+    OptimizerWorkspace() {}
+
+    /// Return a dataDim x amplitudeDim model matrix, reusing memory from previous calls when possible.
+    ndarray::Array<Pixel,2,-1> getModelMatrix(int dataDim, int amplitudeDim);
+
+private:
+    ndarray::Array<Pixel,1,1> _modelMatrixStorage;
+};
+
 /**
  *  @brief Base class for objective functions for Optimizer
  */
@@ -120,9 +141,34 @@ public:
     int const dataSize;
     int const parameterSize;
 
+    /**
+     *  @brief Create an objective that evaluates a Likelihood and (optionally) a Prior.
+     *
+     *  @param[in] likelihood       Likelihood to evaluate.
+     *  @param[in] prior            Prior to evaluate; may be empty.
+     *  @param[in] modelCacheSize   Number of model matrices to keep, keyed on the nonlinear parameters
+     *                              they were computed at; when a point is revisited, or only the
+     *                              amplitudes change, the objective uses the cached matrix instead of
+     *                              calling Likelihood::computeModelMatrix().  The least-recently used
+     *                              matrix is replaced when the cache is full.  A size of nonlinearDim + 2
+     *                              keeps the current point in the cache while numerical derivatives are
+     *                              computed.
+     */
+    static PTR(OptimizerObjective) makeFromLikelihood(
+        PTR(Likelihood) likelihood,
+        PTR(Prior) prior = PTR(Prior)(),
+        int modelCacheSize = 1
+    );
+
+    /**
+     *  Like makeFromLikelihood(likelihood, prior, modelCacheSize), but take the first model matrix buffer
+     *  from a workspace (any additional cache entries are allocated by the objective).
+     */
     static PTR(OptimizerObjective) makeFromLikelihood(
         PTR(Likelihood) likelihood,
-        PTR(Prior) prior = PTR(Prior)()
+        PTR(Prior) prior,
+        PTR(OptimizerWorkspace) workspace,
+        int modelCacheSize = 1
     );
 
     OptimizerObjective(int dataSize_, int parameterSize_) :
@@ -134,11 +180,90 @@ public:
         ndarray::Array<Scalar,1,1> const & output
     ) const;
 
+    /**
+     *  @brief Evaluate the objective at many points, using multiple threads.
+     *
+     *  @param[in]  parameters   Points at which to evaluate the objective (one row per point).
+     *  @param[out] output       Objective value (-ln likelihood*prior) at each point.
+     *  @param[out] chiSquared   If not empty, set to the likelihood term (0.5*|r|^2) at each point.
+     *  @param[out] priorTerms   If not empty, set to the prior term (-ln prior) at each point.
+     *  @param[in]  nThreads     Number of threads to use for the residual evaluations.
+     *
+     *  The points are split into contiguous blocks that are handed out to threads as they become free,
+     *  each using its own clone() of the objective and residual buffer; if the objective cannot be
+     *  cloned, all points are evaluated on the calling thread.  Within a block, residuals are computed
+     *  a few points at a time with computeResidualsBatch().  The prior is always evaluated on the
+     *  calling thread, as Prior objects are not thread-safe in general.
+     */
+    void fillObjectiveValueGrid(
+        ndarray::Array<Scalar const,2,1> const & parameters,
+        ndarray::Array<Scalar,1,1> const & output,
+        ndarray::Array<Scalar,1,1> const & chiSquared,
+        ndarray::Array<Scalar,1,1> const & priorTerms,
+        int nThreads
+    ) const;
+
     virtual void computeResiduals(
         ndarray::Array<Scalar const,1,1> const & parameters,
         ndarray::Array<Scalar,1,1> const & residuals
     ) const = 0;
 
+    /**
+     *  @brief Compute the residuals at several points at once.
+     *
+     *  @param[in]  parameters   Points at which to evaluate the residuals (one row per point).
+     *  @param[out] residuals    nPoints x dataSize array of residuals (one row per point).
+     *
+     *  Used by fillObjectiveValueGrid(), which passes a few points at a time.  The default
+     *  implementation calls computeResiduals() for each point; objectives created by
+     *  makeFromLikelihood() evaluate all the model matrices with a single call to
+     *  Likelihood::computeModelMatrices().
+     */
+    virtual void computeResidualsBatch(
+        ndarray::Array<Scalar const,2,1> const & parameters,
+        ndarray::Array<Scalar,2,2> const & residuals
+    ) const;
+
+    /**
+     *  @brief Compute the columns of the residual Jacobian for parameters the residuals are linear in.
+     *
+     *  @param[in]  parameters   Parameter vector at which to evaluate the derivatives.
+     *  @param[out] jacobian     dataSize x parameterSize matrix of residual derivatives; only the
+     *                           columns at and after the returned index should be filled.
+     *
+     *  @return the index of the first linear parameter; all parameters after it must be linear as well.
+     *
+     *  Optimizer uses this to avoid computing numerical derivatives for linear parameters.  The
+     *  default implementation fills nothing and returns parameterSize.
+     */
+    virtual int differentiateLinearResiduals(
+        ndarray::Array<Scalar const,1,1> const & parameters,
+        ndarray::Array<Scalar,2,-2> const & jacobian
+    ) const {
+        return parameterSize;
+    }
+
+    /// Return true if differentiateResiduals() is implemented.
+    virtual bool hasResidualDerivatives() const { return false; }
+
+    /**
+     *  @brief Compute the Jacobian of the residuals with respect to the parameters.
+     *
+     *  @param[in]  parameters   Parameter vector at which to evaluate the derivatives.
+     *  @param[out] jacobian     dataSize x parameterSize matrix of residual derivatives.
+     *
+     *  @return the number of additional residual (i.e. model) evaluations this required, such as
+     *          the perturbed points of finite differences; Optimizer adds it to
+     *          OptimizerStatistics::residualEvaluations.
+     *
+     *  Only called by Optimizer if hasResidualDerivatives() returns true; the default
+     *  implementation throws LogicError.
+     */
+    virtual int differentiateResiduals(
+        ndarray::Array<Scalar const,1,1> const & parameters,
+        ndarray::Array<Scalar,2,-2> const & jacobian
+    ) const;
+
     virtual bool hasPrior() const { return false; }
 
     virtual Scalar computePrior(ndarray::Array<Scalar const,1,1> const & parameters) const;
@@ -149,9 +274,106 @@ public:
         ndarray::Array<Scalar,2,1> const & hessian
     ) const;
 
+    /**
+     *  @brief Return the natural log of the prior, or -infinity where it is zero.
+     *
+     *  Optimizer only uses the log-domain prior methods; the default implementations delegate to
+     *  computePrior() and differentiatePrior(), but objectives that can should override them to avoid
+     *  underflow far from the peak of the prior.
+     */
+    virtual Scalar computeLogPrior(ndarray::Array<Scalar const,1,1> const & parameters) const;
+
+    /// Compute the first and second derivatives of the natural log of the prior.
+    virtual void differentiateLogPrior(
+        ndarray::Array<Scalar const,1,1> const & parameters,
+        ndarray::Array<Scalar,1,1> const & gradient,
+        ndarray::Array<Scalar,2,1> const & hessian
+    ) const;
+
+    /**
+     *  @brief Return a new objective that can be evaluated concurrently with this one.
+     *
+     *  The default implementation returns an empty pointer, indicating that the objective can only be
+     *  used from one thread at a time.
+     */
+    virtual PTR(OptimizerObjective) clone() const { return PTR(OptimizerObjective)(); }
+
+    /// Return the number of residual evaluations that reused a cached model (0 if there is no cache).
+    virtual int getModelCacheHits() const { return 0; }
+
+    /// Return the number of residual evaluations that had to compute a new model (0 if there is no cache).
+    virtual int getModelCacheMisses() const { return 0; }
+
     virtual ~OptimizerObjective() {}
 };
 
+/**
+ *  @brief An OptimizerObjective that solves for the amplitudes at each point in nonlinear parameter space.
+ *
+ *  This implements the "variable projection" approach to separable least-squares problems: the
+ *  parameters seen by the Optimizer are only the nonlinear parameters, and at each point in that
+ *  space we set the amplitudes to their conditional maximum-posterior values.  If a Prior is
+ *  provided, these are computed using Prior::maximize() (which also enforces any constraints the
+ *  prior puts on the amplitudes); if not, they are the unconstrained linear least-squares solution.
+ *
+ *  Derivatives of the prior are evaluated at the projected amplitudes, but only the nonlinear
+ *  derivatives are used; this is exact when the prior does not depend on the amplitudes (aside from
+ *  constraints), which is true for all the priors we currently use.
+ *
+ *  The projected amplitudes are cached, so repeated calls at the same nonlinear parameters are cheap.
+ */
+class VariableProjectionOptimizerObjective : public OptimizerObjective {
+public:
+
+    VariableProjectionOptimizerObjective(PTR(Likelihood) likelihood, PTR(Prior) prior=PTR(Prior)());
+
+    /// Compute the amplitudes that maximize the posterior at the given nonlinear parameters.
+    void computeAmplitudes(
+        ndarray::Array<Scalar const,1,1> const & nonlinear,
+        ndarray::Array<Scalar,1,1> const & amplitudes
+    ) const;
+
+    virtual void computeResiduals(
+        ndarray::Array<Scalar const,1,1> const & nonlinear,
+        ndarray::Array<Scalar,1,1> const & residuals
+    ) const;
+
+    virtual bool hasPrior() const { return _prior; }
+
+    virtual Scalar computePrior(ndarray::Array<Scalar const,1,1> const & nonlinear) const;
+
+    virtual void differentiatePrior(
+        ndarray::Array<Scalar const,1,1> const & nonlinear,
+        ndarray::Array<Scalar,1,1> const & gradient,
+        ndarray::Array<Scalar,2,1> const & hessian
+    ) const;
+
+    virtual Scalar computeLogPrior(ndarray::Array<Scalar const,1,1> const & nonlinear) const;
+
+    virtual void differentiateLogPrior(
+        ndarray::Array<Scalar const,1,1> const & nonlinear,
+        ndarray::Array<Scalar,1,1> const & gradient,
+        ndarray::Array<Scalar,2,1> const & hessian
+    ) const;
+
+    virtual PTR(OptimizerObjective) clone() const;
+
+private:
+
+    void _update(ndarray::Array<Scalar const,1,1> const & nonlinear) const;
+
+    PTR(Likelihood) _likelihood;
+    PTR(Prior) _prior;
+    ndarray::Array<Pixel,2,-1> _modelMatrix;
+    ndarray::Array<Scalar,1,1> _nonlinear; // nonlinear parameters the cached quantities were computed at
+    ndarray::Array<Scalar,1,1> _amplitudes;
+    ndarray::Array<Scalar,1,1> _amplitudeGradient;
+    ndarray::Array<Scalar,2,1> _amplitudeHessian;
+    ndarray::Array<Scalar,2,1> _crossHessian;
+    mutable Vector _gradient;
+    mutable Matrix _hessian;
+};
+
 /**
  *  @brief Configuration object for Optimizer
  *
@@ -206,6 +428,19 @@ public:
         "step size (in units of trust radius) used for numerical derivatives (added to relative step)"
     );
 
+    LSST_CONTROL_FIELD(
+        numDiffThreads, int,
+        "number of threads used to compute numerical derivatives (ignored if the objective cannot be cloned)"
+    );
+
+    LSST_CONTROL_FIELD(
+        doUseResidualDerivatives, bool,
+        "If true, use the objective's residual derivatives (if it has them) instead of differencing the "
+        "residuals.  For likelihood objectives these are still forward differences, but of the model matrix "
+        "(see Likelihood::computeModelMatrixDerivatives), which can skip blocks that don't depend on each "
+        "parameter; they are not analytic."
+    );
+
     LSST_CONTROL_FIELD(
         stepAcceptThreshold, double,
         "steps with reduction ratio greater than this are accepted"
@@ -246,6 +481,37 @@ public:
         "value passed as the tolerance to solveTrustRegion"
     );
 
+    LSST_CONTROL_FIELD(
+        doUseConjugateGradient, bool,
+        "If true, solve trust region subproblems approximately with truncated conjugate gradient "
+        "(Steihaug) iterations, using only Hessian-vector products; this avoids forming J^T J and "
+        "scales better to problems with many parameters"
+    );
+
+    LSST_CONTROL_FIELD(
+        conjugateGradientTolerance, double,
+        "conjugate gradient iterations stop when the residual norm falls below this fraction of the gradient "
+        "norm (only used if doUseConjugateGradient is true)"
+    );
+
+    LSST_CONTROL_FIELD(
+        conjugateGradientMaxIterations, int,
+        "maximum number of conjugate gradient iterations per trust region subproblem; <= 0 uses the "
+        "number of parameters (only used if doUseConjugateGradient is true)"
+    );
+
+    LSST_CONTROL_FIELD(
+        jacobianRefreshInterval, int,
+        "recompute the full Jacobian of the residuals at least once every this many accepted steps, "
+        "updating it with Broyden's rank-1 secant formula in between; 1 recomputes it at every step"
+    );
+
+    LSST_CONTROL_FIELD(
+        jacobianRefreshReductionRatio, double,
+        "always recompute the full Jacobian after accepting a step whose reduction ratio is less than "
+        "this, instead of using a Broyden update (only used if jacobianRefreshInterval > 1)"
+    );
+
     LSST_CONTROL_FIELD(
         maxInnerIterations, int,
         "maximum number of iterations (i.e. function evaluations and trust region subproblems) per step"
@@ -266,6 +532,8 @@ public:
         minTrustRadiusThreshold(1E-5),
         gradientThreshold(1E-5),
         numDiffRelStep(0.0), numDiffAbsStep(0.0), numDiffTrustRadiusStep(0.1),
+        numDiffThreads(1),
+        doUseResidualDerivatives(false),
         stepAcceptThreshold(0.0),
         trustRegionInitialSize(1.0),
         trustRegionGrowReductionRatio(0.75),
@@ -274,12 +542,50 @@ public:
         trustRegionShrinkReductionRatio(0.25),
         trustRegionShrinkFactor(1.0/3.0),
         trustRegionSolverTolerance(1E-8),
+        doUseConjugateGradient(false),
+        conjugateGradientTolerance(1E-6),
+        conjugateGradientMaxIterations(0),
+        jacobianRefreshInterval(1),
+        jacobianRefreshReductionRatio(0.5),
         maxInnerIterations(20),
         maxOuterIterations(500),
         doSaveIterations(false)
     {}
 };
 
+/**
+ *  @brief Counters and timers describing the work done by an Optimizer since it was last reset.
+ *
+ *  Times are wall-clock seconds, measured with boost::posix_time::microsec_clock::universal_time(),
+ *  so they include time the process spends descheduled, and are not protected against the system
+ *  clock being adjusted while a fit runs (we avoid a dependency on boost_chrono for a monotonic
+ *  clock).  When numerical derivatives are computed with multiple threads, modelTime includes only
+ *  the elapsed time, not the total over all threads.
+ *
+ *  residualEvaluations counts the residuals evaluated by the Optimizer itself, including the
+ *  perturbed points of numerical derivatives, plus those reported by
+ *  OptimizerObjective::differentiateResiduals() when OptimizerControl::doUseResidualDerivatives is set.
+ */
+struct OptimizerStatistics {
+    int residualEvaluations;   ///< number of evaluations of the residuals, including derivatives
+    int jacobianEvaluations;   ///< number of times the Jacobian, gradient, and Hessian were computed
+    int broydenUpdates;        ///< number of times the Jacobian was updated with a Broyden secant step
+    int modelCacheHits;        ///< number of model evaluations served by the objective's model cache
+    int modelCacheMisses;      ///< number of model evaluations that missed the objective's model cache
+    int outerIterations;       ///< number of calls to Optimizer::step(), including the final one
+    int innerIterations;       ///< number of trust region subproblems solved
+    int rejectedSteps;         ///< number of inner iterations whose step was rejected
+    double modelTime;          ///< time spent computing residuals and their derivatives
+    double priorTime;          ///< time spent computing the prior and its derivatives
+    double trustRegionTime;    ///< time spent factoring the Hessian and solving trust region subproblems
+    int conjugateGradientIterations; ///< total Steihaug-CG iterations (if doUseConjugateGradient)
+
+    OptimizerStatistics() { reset(); }
+
+    /// Set all counters and timers to zero.
+    void reset();
+};
+
 /**
  *  @brief Internal struct used for per-iteration optimizer data, made public for debugging purposes.
  *
@@ -287,13 +593,20 @@ public:
  */
 struct OptimizerIterationData {
     Scalar objectiveValue;
-    Scalar priorValue;
+    Scalar priorValue;    // P(x), not ln P(x); kept only for history recording and debugging
     ndarray::Array<Scalar,1,1> parameters;
     ndarray::Array<Scalar,1,1> residuals;
 
     OptimizerIterationData(int dataSize, int parameterSize);
 
+    /// Resize the parameter and residual arrays, reusing existing memory when it is large enough.
+    void reset(int dataSize, int parameterSize);
+
     void swap(OptimizerIterationData & other);
+
+private:
+    ndarray::Array<Scalar,1,1> _parameterStorage;
+    ndarray::Array<Scalar,1,1> _residualStorage;
 };
 
 class OptimizerHistoryRecorder {
@@ -358,6 +671,180 @@ public:
     ArrayKey derivatives;
 };
 
+/**
+ *  @brief A compact, preallocated alternative to recording Optimizer history directly into a catalog.
+ *
+ *  OptimizerHistoryRecorder::apply() adds a new record to a catalog for every inner iteration, which
+ *  can easily dominate the time spent in an optimizer run.  OptimizerHistoryBuffer instead copies the
+ *  same information into fixed-size arrays allocated once in the constructor, so appending an entry
+ *  never allocates memory.  The buffer is a ring: when it is full, each new entry overwrites the oldest
+ *  one.  The contents can be converted to a catalog with the usual OptimizerHistoryRecorder schema by
+ *  calling copyTo(), which need only be done for the fits that are actually of interest.
+ */
+class OptimizerHistoryBuffer {
+public:
+
+    /**
+     *  @brief Construct an empty buffer
+     *
+     *  @param[in] parameterSize         Number of parameters in the objective.
+     *  @param[in] capacity              Maximum number of entries; older entries are overwritten
+     *                                   beyond this.
+     *  @param[in] doRecordDerivatives   Whether to save the gradient and Hessian for each accepted step.
+     */
+    OptimizerHistoryBuffer(int parameterSize, int capacity, bool doRecordDerivatives);
+
+    /// Add an entry describing the current state of the optimizer.
+    void append(int outerIterCount, int innerIterCount, Optimizer const & optimizer);
+
+    /// Remove all entries (but keep the memory).
+    void clear() { _size = 0; _dropped = 0; _next = 0; }
+
+    /// Return the number of entries currently held.
+    int getSize() const { return _size; }
+
+    /// Return the maximum number of entries that can be held.
+    int getCapacity() const { return _entries.size(); }
+
+    /// Return the number of entries overwritten since the last call to clear().
+    int getDroppedCount() const { return _dropped; }
+
+    /**
+     *  @brief Append all entries, oldest first, to a catalog whose schema was set up by the given recorder.
+     *
+     *  If the recorder's schema has a derivatives field, the buffer must have been constructed with
+     *  doRecordDerivatives=true.
+     */
+    void copyTo(OptimizerHistoryRecorder const & recorder, afw::table::BaseCatalog & history) const;
+
+private:
+
+    struct Entry {
+        int outer;
+        int inner;
+        int state;
+        Scalar objective;
+        Scalar prior;
+        Scalar trust;
+    };
+
+    int _parameterSize;
+    int _size;
+    int _dropped;
+    int _next;
+    std::vector<Entry> _entries;
+    ndarray::Array<Scalar,2,2> _parameters;
+    ndarray::Array<Scalar,2,2> _derivatives;
+};
+
+/**
+ *  @brief Solve a symmetric quadratic matrix equation with a ball constraint.
+ *
+ *  This computes a near-exact solution to the "trust region subproblem" necessary
+ *  in trust-region-based nonlinear optimizers:
+ *  @f[
+ *   \min_x{\quad g^T x + \frac{1}{2}x^T F x}\quad\quad\quad \text{s.t.} ||x|| \le r
+ *  @f]
+ *
+ *  The tolerance parameter sets how close to @f$r@f$ we require the norm of the
+ *  solution to be when it lies on the constraint, as a fraction of @f$r@f$ itself.
+ *
+ *  This implementation is based on the algorithm described in Section 4.3 of
+ *  "Nonlinear Optimization" by Nocedal and Wright.  Problems with up to 16 dimensions are
+ *  dispatched to fixed-size specializations that do not allocate memory.
+ */
+void solveTrustRegion(
+    ndarray::Array<Scalar,1,1> const & x,
+    ndarray::Array<Scalar const,2,1> const & F, ndarray::Array<Scalar const,1,1> const & g,
+    double r, double tolerance
+);
+
+/**
+ *  @brief Solver for a sequence of trust region subproblems that share the same matrix.
+ *
+ *  Most of the work in solveTrustRegion() goes into the eigendecomposition of F, which doesn't depend
+ *  on the gradient or the trust radius.  This class computes that decomposition once, in setMatrix(),
+ *  and reuses it in every subsequent call to solve(), which is what Optimizer needs when a step is
+ *  rejected and only the trust radius changes.
+ */
+class TrustRegionSolver {
+public:
+
+    TrustRegionSolver() {}
+
+    /// Compute and save the eigendecomposition of the (symmetric) matrix F.
+    void setMatrix(ndarray::Array<Scalar const,2,1> const & F);
+
+    /// Solve the trust region subproblem for the matrix passed to the last call to setMatrix().
+    void solve(
+        ndarray::Array<Scalar,1,1> const & x,
+        ndarray::Array<Scalar const,1,1> const & g,
+        double r, double tolerance
+    );
+
+private:
+    Matrix _eigenvectors;
+    Vector _eigenvalues;
+    Vector _qtg;
+    Vector _tmp;
+};
+
+/**
+ *  @brief Approximate trust region subproblem solver using truncated conjugate gradient iterations.
+ *
+ *  This implements the Steihaug method described in Section 7.2 of "Nonlinear Optimization" by
+ *  Nocedal and Wright.  It only requires products of the matrix with vectors, and the matrix is
+ *  passed as @f$F = H + J^T J@f$, so the Gauss-Newton term never has to be formed explicitly; each
+ *  product costs @f$O(mn)@f$ instead of the @f$O(n^3)@f$ of the eigendecomposition used by
+ *  solveTrustRegion().  The solution is approximate: iteration stops when the residual of the
+ *  unconstrained problem drops below the given tolerance (relative to the norm of g), when the
+ *  iterates leave the trust region, or when a direction of negative curvature is found.  In the
+ *  latter two cases, the solution lies on the boundary of the trust region.
+ *
+ *  The workspace vectors are reused between calls, so a single solver should not be shared
+ *  between threads.
+ */
+class SteihaugSolver {
+public:
+
+    /**
+     *  @brief Construct the solver.
+     *
+     *  @param[in] maxIterations   Maximum number of conjugate gradient iterations; if <= 0, the
+     *                             dimension of the problem will be used.
+     */
+    explicit SteihaugSolver(int maxIterations=0) : _maxIterations(maxIterations), _iterations(0) {}
+
+    /**
+     *  @brief Solve the trust region subproblem for the matrix @f$H + J^T J@f$
+     *
+     *  @param[out] x          Solution vector.
+     *  @param[in]  H          Symmetric matrix (n x n).
+     *  @param[in]  J          Jacobian matrix (m x n); may be empty, in which case only H is used.
+     *  @param[in]  g          Gradient vector (n).
+     *  @param[in]  r          Trust region radius.
+     *  @param[in]  tolerance  Convergence threshold for the residual norm, relative to the norm of g.
+     */
+    void solve(
+        ndarray::Array<Scalar,1,1> const & x,
+        ndarray::Array<Scalar const,2,1> const & H,
+        ndarray::Array<Scalar const,2,-2> const & J,
+        ndarray::Array<Scalar const,1,1> const & g,
+        double r, double tolerance
+    );
+
+    /// Return the number of conjugate gradient iterations used in the last call to solve().
+    int getIterations() const { return _iterations; }
+
+private:
+    int _maxIterations;
+    int _iterations;
+    Vector _residual;
+    Vector _direction;
+    Vector _product;
+    Vector _dataWorkspace;
+};
+
 /**
  *  @brief A numerical optimizer customized for least-squares problems with Bayesian priors
  *
@@ -366,7 +853,8 @@ public:
  *  maintaining a matrix of corrections to this to account for large residuals, which is updated
  *  using a symmetric rank-1 (SR1) secant formula.  We assume the prior has analytic first and second
  *  derivatives, but use numerical derivatives to compute the Jacobian of the residuals at every
- *  step.  A trust region approach is used to ensure global convergence.
+ *  step (unless OptimizerControl::doUseResidualDerivatives is set and the objective can compute them
+ *  itself).  A trust region approach is used to ensure global convergence.
  *
  *  We consider the function @f$f(x)@f$ we wish to optimize to have two terms, which correspond to
  *  negative log likelihood (@f$\chi^2/2=\|r(x)|^2@f$, where @f$r(x)@f$ is the vector of residuals
@@ -400,6 +888,21 @@ public:
  *  dog-leg approach to the trust region problem.  As a result, we should require fewer steps to
  *  converge, but spend more time computing each step; this is ideal when we expect the time spent
  *  in function evaluation to dominate the time per step anyway.
+ *
+ *  Near convergence, steps are typically small enough that the Jacobian changes little between them.
+ *  If OptimizerControl::jacobianRefreshInterval is greater than one, the Jacobian is only recomputed
+ *  (usually via numerical derivatives) every few steps, and between those it is updated using
+ *  Broyden's formula:
+ *  @f[
+ *   J_{k+1} = J_k + \frac{(r_{k+1} - r_k - J_k s) s^T}{s^T s}
+ *  @f]
+ *  A full recomputation is also forced when a step's reduction ratio indicates that the quadratic
+ *  model was poor, and before declaring convergence based on the gradient.
+ *
+ *  By default, each trust region subproblem is solved nearly exactly with solveTrustRegion().  For
+ *  problems with many parameters, OptimizerControl::doUseConjugateGradient selects SteihaugSolver
+ *  instead, which only needs products of @f$H_k@f$ with vectors; in that case @f$J_k^T J_k@f$ is
+ *  never formed, except when the full Hessian is requested via getHessian().
  */
 class Optimizer {
 public:
@@ -407,6 +910,7 @@ public:
     typedef OptimizerObjective Objective;
     typedef OptimizerControl Control;
     typedef OptimizerHistoryRecorder HistoryRecorder;
+    typedef OptimizerHistoryBuffer HistoryBuffer;
     typedef OptimizerIterationData IterationData;
     typedef std::vector<IterationData> IterationDataVector;
 
@@ -435,6 +939,44 @@ public:
         Control const & ctrl
     );
 
+    /**
+     *  @brief Reinitialize the optimizer with a new objective and starting point.
+     *
+     *  This is equivalent to constructing a new Optimizer with the same control object, but reuses
+     *  the memory already allocated when it is large enough, making it cheaper to fit many objects in
+     *  sequence.  Arrays previously returned by the accessors may be overwritten.
+     */
+    void reset(PTR(Objective const) objective, ndarray::Array<Scalar const,1,1> const & parameters);
+
+    /**
+     *  @brief Construct an Optimizer that is "warm-started" from a previous fit.
+     *
+     *  @param[in] objective     Objective function to minimize.
+     *  @param[in] parameters    Initial parameters, typically the best-fit parameters of a previous fit.
+     *  @param[in] ctrl          Control object.
+     *  @param[in] hessian       Initial estimate of the Hessian of the objective at parameters, such as
+     *                           the inverse of the covariance matrix estimated by a previous fit.  Unless
+     *                           ctrl.noSR1Term is true, the difference between this and the Gauss-Newton
+     *                           Hessian is used as the initial SR1 correction matrix.  May be empty, in
+     *                           which case the Hessian is computed as for a cold start.
+     *  @param[in] trustRadius   Initial trust radius; if not positive, ctrl.trustRegionInitialSize is used.
+     */
+    Optimizer(
+        PTR(Objective const) objective,
+        ndarray::Array<Scalar const,1,1> const & parameters,
+        Control const & ctrl,
+        ndarray::Array<Scalar const,2,1> const & hessian,
+        double trustRadius
+    );
+
+    /// Reinitialize the optimizer with a warm start; see the corresponding constructor and reset().
+    void reset(
+        PTR(Objective const) objective,
+        ndarray::Array<Scalar const,1,1> const & parameters,
+        ndarray::Array<Scalar const,2,1> const & hessian,
+        double trustRadius
+    );
+
     PTR(Objective const) getObjective() const { return _objective; }
 
     Control const & getControl() const { return _ctrl; }
@@ -451,6 +993,10 @@ public:
         return _runImpl(&recorder, &history);
     }
 
+    bool step(HistoryBuffer & buffer) { return _stepImpl(0, NULL, NULL, &buffer); }
+
+    int run(HistoryBuffer & buffer) { return _runImpl(NULL, NULL, &buffer); }
+
     int getState() const { return _state; }
 
     Scalar getObjectiveValue() const { return _current.objectiveValue; }
@@ -461,21 +1007,71 @@ public:
 
     ndarray::Array<Scalar const,1,1> getGradient() const { return _gradient; }
 
-    ndarray::Array<Scalar const,2,2> getHessian() const { return _hessian; }
+    /// Return the current trust radius, e.g. to warm-start another optimizer from this one's result.
+    double getTrustRadius() const { return _trustRadius; }
+
+    /**
+     *  @brief Return the Hessian of the quadratic model at the current parameters.
+     *
+     *  When OptimizerControl::doUseConjugateGradient is set, the optimizer itself never forms the
+     *  J^T J term, and this assembles a new matrix each time it is called.
+     */
+    ndarray::Array<Scalar const,2,2> getHessian() const;
+
+    /// Return counters and timers for the work done since construction or the last call to reset().
+    OptimizerStatistics const & getStatistics() const { return _statistics; }
 
 private:
 
     friend class OptimizerHistoryRecorder;
+    friend class OptimizerHistoryBuffer;
+    friend class BatchOptimizer;
 
     bool _stepImpl(
         int outerIterCount,
         HistoryRecorder const * recorder=NULL,
-        afw::table::BaseCatalog * history=NULL
+        afw::table::BaseCatalog * history=NULL,
+        HistoryBuffer * buffer=NULL
     );
 
-    int _runImpl(HistoryRecorder const * recorder=NULL, afw::table::BaseCatalog * history=NULL);
+    int _runImpl(
+        HistoryRecorder const * recorder=NULL,
+        afw::table::BaseCatalog * history=NULL,
+        HistoryBuffer * buffer=NULL
+    );
 
-    void _computeDerivatives();
+    void _recordHistory(
+        int outerIterCount,
+        int innerIterCount,
+        HistoryRecorder const * recorder,
+        afw::table::BaseCatalog * history,
+        HistoryBuffer * buffer
+    ) const {
+        if (recorder) recorder->apply(outerIterCount, innerIterCount, *history, *this);
+        if (buffer) buffer->append(outerIterCount, innerIterCount, *this);
+    }
+
+    // Compute the gradient and Hessian, recomputing the Jacobian first if doUpdateJacobian is true.
+    void _computeDerivatives(bool doUpdateJacobian=true);
+
+    // Apply Broyden's rank-1 update to _jacobian, using _step and the residuals in _current (new)
+    // and _next (old); the latter are overwritten.
+    void _updateJacobianBroyden();
+
+    // Return an element of the full model Hessian, including the J^T J term that _hessian
+    // doesn't hold when doUseConjugateGradient is set.
+    Scalar _getHessianElement(int i, int j) const {
+        Scalar result = _hessian(i, j);
+        if (_ctrl.doUseConjugateGradient) {
+            result += _jacobian.asEigen().col(i).dot(_jacobian.asEigen().col(j));
+        }
+        return result;
+    }
+
+    void _computeNumDiffColumn(int n, int worker);
+
+    // Copy the model cache counters of the objective (and its clones) to _statistics.
+    void _updateModelCacheStatistics();
 
     int _state;
     PTR(Objective const) _objective;
@@ -483,35 +1079,207 @@ private:
     double _trustRadius;
     IterationData _current;
     IterationData _next;
+    std::vector<PTR(Objective const)> _workerObjectives; // clones of _objective for threads other than 0
+    IterationDataVector _workerData;                      // workspace for threads other than 0
+    PTR(ParallelForPool) _numDiffPool; // threads for numerical derivatives; kept across calls to reset()
     ndarray::Array<Scalar,1,1> _step;
     ndarray::Array<Scalar,1,1> _gradient;
-    ndarray::Array<Scalar,2,2> _hessian;
-    Matrix _jacobian;
+    ndarray::Array<Scalar,2,2> _hessian;        // excludes J^T J when doUseConjugateGradient is set
+    ndarray::Array<Scalar,2,-2> _jacobian;
+    ndarray::Array<Scalar,1,1> _vectorStorage;   // memory for _step and _gradient, reused by reset()
+    ndarray::Array<Scalar,1,1> _hessianStorage;  // memory for _hessian, reused by reset()
+    ndarray::Array<Scalar,1,1> _jacobianStorage; // memory for _jacobian, reused by reset()
     Matrix _sr1b;
     Vector _sr1v;
     Vector _sr1jtr;
+    TrustRegionSolver _trustRegionSolver;
+    bool _isHessianFactored; // whether _trustRegionSolver holds the decomposition of the current _hessian
+    int _broydenUpdateCount; // number of Broyden updates since _jacobian was last fully recomputed
+    int _modelCacheHitsBaseline;   // _objective->getModelCacheHits() when reset() was called
+    int _modelCacheMissesBaseline; // _objective->getModelCacheMisses() when reset() was called
+    SteihaugSolver _steihaugSolver;
+    OptimizerStatistics _statistics;
 };
 
 /**
- *  @brief Solve a symmetric quadratic matrix equation with a ball constraint.
+ *  @brief Runs many independent Optimizers in lockstep.
  *
- *  This computes a near-exact solution to the "trust region subproblem" necessary
- *  in trust-region-based nonlinear optimizers:
- *  @f[
- *   \min_x{\quad g^T x + \frac{1}{2}x^T F x}\quad\quad\quad \text{s.t.} ||x|| \le r
- *  @f]
+ *  BatchOptimizer holds a set of independent problems with the same number of parameters, and
+ *  advances all of them by one outer iteration (see Optimizer::step()) at a time.  Problems are
+ *  retired from the batch as soon as they converge or fail, so each subsequent step only does
+ *  work for the problems that remain.
  *
- *  The tolerance parameter sets how close to @f$r@f$ we require the norm of the
- *  solution to be when it lies on the constraint, as a fraction of @f$r@f$ itself.
+ *  Each step is just a loop over the active problems that calls each one's own Optimizer; the
+ *  linear algebra (trust region solves, SR1 updates) is not batched or vectorized across problems.
+ *  What the batch does provide is a single driver for many fits, and the option of running that
+ *  loop on multiple threads.  That is only safe if the objectives share no mutable state; note that
+ *  this is not true of objectives that share a MixturePrior, as Mixture uses internal workspace.
  *
- *  This implementation is based on the algorithm described in Section 4.3 of
- *  "Nonlinear Optimization" by Nocedal and Wright.
+ *  A problem that throws an exception, either while it is being added (the Optimizer constructor
+ *  evaluates the objective and its derivatives) or in a later step, is marked with
+ *  Optimizer::FAILED_EXCEPTION and retired; the other problems are unaffected.
+ *
+ *  The current parameters, objective values, and state flags of all problems are kept in
+ *  contiguous arrays (one row per problem), which are updated after every step.  The full
+ *  Optimizer for each problem is also available via getOptimizer(), e.g. for
+ *  OptimizerInterpreter::attachPdf().
+ *
+ *  Problems must all be added via add() before the first call to step() or run().
  */
-void solveTrustRegion(
-    ndarray::Array<Scalar,1,1> const & x,
-    ndarray::Array<Scalar const,2,1> const & F, ndarray::Array<Scalar const,1,1> const & g,
-    double r, double tolerance
-);
+class BatchOptimizer {
+public:
+
+    typedef OptimizerObjective Objective;
+    typedef OptimizerControl Control;
+
+    /**
+     *  @brief Construct an empty batch
+     *
+     *  @param[in] parameterSize   Number of parameters in every problem.
+     *  @param[in] ctrl            Control object used for all problems.
+     *  @param[in] nThreads        Number of threads the loop over problems at each step is run on.
+     */
+    BatchOptimizer(int parameterSize, Control const & ctrl, int nThreads=1);
+
+    /**
+     *  @brief Add a new problem to the batch, returning its index.
+     *
+     *  Throws LengthError if the objective or parameters do not have the batch's parameter size.
+     *  If the initial evaluation of the objective throws, the problem is still added (so indices
+     *  always match the order of calls to add()), but it starts out in the FAILED_EXCEPTION state,
+     *  with NaN objective value and parameters, and getOptimizer() throws for it.
+     */
+    int add(PTR(Objective const) objective, ndarray::Array<Scalar const,1,1> const & parameters);
+
+    /// Add a new warm-started problem to the batch, returning its index; see the Optimizer constructor.
+    int add(
+        PTR(Objective const) objective,
+        ndarray::Array<Scalar const,1,1> const & parameters,
+        ndarray::Array<Scalar const,2,1> const & hessian,
+        double trustRadius
+    );
+
+    /// Advance all active problems by one outer iteration, returning the number still active.
+    int step();
+
+    /// Step until all problems have converged or failed, returning the number of outer iterations.
+    int run();
+
+    /**
+     *  @brief Stop stepping the problem with the given index, leaving its state unchanged.
+     *
+     *  Returns false if the problem had already converged, failed, or been retired.
+     */
+    bool retire(int index);
+
+    /// Return the number of problems in the batch.
+    int getSize() const { return _optimizers.size(); }
+
+    /// Return the number of problems that have not yet converged or failed.
+    int getActiveCount() const { return _active.size(); }
+
+    /// Return the Optimizer for the problem with the given index; throws if its initialization failed.
+    Optimizer const & getOptimizer(int index) const;
+
+    /// Return the Optimizer::StateFlags for all problems.
+    ndarray::Array<int const,1,1> getStates() const { return _states; }
+
+    /// Return the current objective values for all problems.
+    ndarray::Array<Scalar const,1,1> getObjectiveValues() const { return _objectiveValues; }
+
+    /// Return the current parameters for all problems (one row per problem).
+    ndarray::Array<Scalar const,2,2> getParameters() const { return _parameters; }
+
+private:
+
+    void _initialize();
+
+    void _stepOne(int index);
+
+    int _parameterSize;
+    int _nThreads;
+    int _outerIterCount;
+    Control _ctrl;
+    PTR(ParallelForPool) _pool; // started when the batch starts, and reused by every step()
+    std::vector<PTR(Optimizer)> _optimizers;
+    std::vector<int> _active;
+    std::vector<int> _stepResults; // not vector<bool>, as it's written concurrently
+    ndarray::Array<int,1,1> _states;
+    ndarray::Array<Scalar,1,1> _objectiveValues;
+    ndarray::Array<Scalar,2,2> _parameters;
+};
+
+/**
+ *  @brief Runs several Optimizers on the same problem from different starting points, and picks the best.
+ *
+ *  The starts are advanced in lockstep by a BatchOptimizer (and hence can be distributed over
+ *  multiple threads, subject to the same restrictions).  After each step, any start whose objective
+ *  value is worse than the best objective value of all converged or still-running starts by more than
+ *  abandonThreshold is abandoned, so starts that are heading for a poor local minimum stop consuming
+ *  time early.
+ */
+class MultiStartOptimizer {
+public:
+
+    typedef OptimizerObjective Objective;
+    typedef OptimizerControl Control;
+
+    /**
+     *  @brief Construct with no starts
+     *
+     *  @param[in] parameterSize      Number of parameters in the problem.
+     *  @param[in] ctrl               Control object used for all starts.
+     *  @param[in] abandonThreshold   Starts whose objective exceeds the best by more than this are
+     *                                abandoned.
+     *  @param[in] nThreads           Number of threads to distribute the starts over at each step.
+     */
+    MultiStartOptimizer(int parameterSize, Control const & ctrl, double abandonThreshold, int nThreads=1);
+
+    /**
+     *  @brief Add a new starting point, returning its index.
+     *
+     *  Each start should have its own objective, though they may share a Likelihood and Prior if
+     *  nThreads == 1.
+     */
+    int add(PTR(Objective const) objective, ndarray::Array<Scalar const,1,1> const & parameters) {
+        int index = _batch.add(objective, parameters);
+        _abandoned.push_back(0);
+        return index;
+    }
+
+    /// Run all starts until they converge, fail, or are abandoned; returns the index of the best one.
+    int run();
+
+    /// Return the number of starts.
+    int getSize() const { return _batch.getSize(); }
+
+    /// Return the index of the start with the lowest objective value that did not fail (or -1 if all did).
+    int getBestIndex() const { return _bestIndex; }
+
+    /// Return the Optimizer for the start with the given index.
+    Optimizer const & getOptimizer(int index) const { return _batch.getOptimizer(index); }
+
+    /// Return the Optimizer for the best start; throws if all starts failed.
+    Optimizer const & getBest() const;
+
+    /// Return whether the start with the given index was abandoned.
+    bool isAbandoned(int index) const { return _abandoned.at(index); }
+
+    /// Return the number of starts that were abandoned.
+    int getAbandonedCount() const;
+
+    /// Return the BatchOptimizer that holds all starts.
+    BatchOptimizer const & getBatch() const { return _batch; }
+
+private:
+
+    void _update();
+
+    double _abandonThreshold;
+    int _bestIndex;
+    BatchOptimizer _batch;
+    std::vector<int> _abandoned;
+};
 
 }}} // namespace lsst::meas::multifit
 
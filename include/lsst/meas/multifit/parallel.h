@@ -0,0 +1,179 @@
+// -*- lsst-c++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2008-2013 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+#ifndef LSST_MEAS_MULTIFIT_parallel_h_INCLUDED
+#define LSST_MEAS_MULTIFIT_parallel_h_INCLUDED
+
+#include <algorithm>
+
+#include "boost/noncopyable.hpp"
+#include "boost/function.hpp"
+#include "boost/thread/thread.hpp"
+#include "boost/thread/mutex.hpp"
+#include "boost/thread/condition_variable.hpp"
+#include "boost/exception_ptr.hpp"
+
+namespace lsst { namespace meas { namespace multifit {
+
+namespace detail {
+
+template <typename Function>
+class ParallelForWorker {
+public:
+
+    ParallelForWorker(
+        int size, int worker, int & next, boost::mutex & mutex, boost::exception_ptr & error,
+        Function & function
+    ) : _size(size), _worker(worker), _next(next), _mutex(mutex), _error(error), _function(function) {}
+
+    void operator()() {
+        try {
+            for (int i = _claim(); i < _size; i = _claim()) {
+                _function(i, _worker);
+            }
+        } catch (...) {
+            boost::mutex::scoped_lock lock(_mutex);
+            if (!_error) _error = boost::current_exception();
+            _next = _size; // stop other workers from starting new iterations
+        }
+    }
+
+private:
+
+    int _claim() {
+        boost::mutex::scoped_lock lock(_mutex);
+        return _next < _size ? _next++ : _size;
+    }
+
+    int _size;
+    int _worker;
+    int & _next;
+    boost::mutex & _mutex;
+    boost::exception_ptr & _error;
+    Function & _function;
+};
+
+} // namespace detail
+
+/**
+ *  @brief Call function(i, worker) for all i in [0, size), using up to nThreads threads.
+ *
+ *  Iterations are handed out to threads one at a time as they become free, so they need not take
+ *  the same amount of time.  The worker argument is the index (in [0, nThreads)) of the thread that
+ *  is processing an iteration; callers can use it to give each thread its own workspace.  Worker 0
+ *  is always the calling thread, and if nThreads <= 1 all iterations are run serially, in order, on
+ *  the calling thread.
+ *
+ *  If any iteration throws, no new iterations are started, and the first exception is rethrown in
+ *  the calling thread after all threads have finished.
+ *
+ *  Each call starts and joins its own threads.  That is fine for a single long loop (such as
+ *  evaluating an objective on a large grid), but loops that run once per model evaluation or
+ *  optimizer step should use a ParallelForPool instead, so they don't pay for thread creation and
+ *  teardown every time.
+ */
+template <typename Function>
+void parallelFor(int size, int nThreads, Function function) {
+    if (nThreads <= 1 || size <= 1) {
+        for (int i = 0; i < size; ++i) {
+            function(i, 0);
+        }
+        return;
+    }
+    nThreads = std::min(nThreads, size);
+    int next = 0;
+    boost::mutex mutex;
+    boost::exception_ptr error;
+    boost::thread_group threads;
+    for (int worker = 1; worker < nThreads; ++worker) {
+        threads.create_thread(
+            detail::ParallelForWorker<Function>(size, worker, next, mutex, error, function)
+        );
+    }
+    detail::ParallelForWorker<Function>(size, 0, next, mutex, error, function)();
+    threads.join_all();
+    if (error) {
+        boost::rethrow_exception(error);
+    }
+}
+
+/**
+ *  @brief A persistent set of threads for running parallelFor-style loops repeatedly.
+ *
+ *  The pool starts nThreads - 1 threads on construction (the thread that calls run() is always
+ *  worker 0), and they wait on a condition variable between calls.  run() has the same semantics
+ *  as parallelFor(), including exception handling.
+ *
+ *  run() is not reentrant: it must not be called from two threads at once, or from inside one of
+ *  its own iterations, so objects that own a pool should give each of their clones its own.
+ */
+class ParallelForPool : private boost::noncopyable {
+public:
+
+    explicit ParallelForPool(int nThreads);
+
+    /// Return the number of threads used by run(), including the calling thread.
+    int getThreadCount() const { return _nThreads; }
+
+    /// Call function(i, worker) for all i in [0, size); see parallelFor().
+    template <typename Function>
+    void run(int size, Function function) {
+        if (_nThreads <= 1 || size <= 1) {
+            for (int i = 0; i < size; ++i) {
+                function(i, 0);
+            }
+            return;
+        }
+        _run(size, boost::function<void (int, int)>(function));
+    }
+
+    /// Stop and join all threads.
+    ~ParallelForPool();
+
+private:
+
+    void _run(int size, boost::function<void (int, int)> const & function);
+
+    // Main loop of the threads started by the constructor.
+    void _wait(int worker);
+
+    // Run iterations of the current loop until there are none left.
+    void _work(int worker);
+
+    int const _nThreads;
+    int _size;
+    int _next;
+    int _generation;   // incremented for each call to run(), so threads know when to start
+    int _nBusy;        // number of started threads still working on the current loop
+    bool _isShutdown;
+    boost::function<void (int, int)> _function;
+    boost::exception_ptr _error;
+    boost::mutex _mutex;
+    boost::condition_variable _startCondition;
+    boost::condition_variable _doneCondition;
+    boost::thread_group _threads;
+};
+
+}}} // namespace lsst::meas::multifit
+
+#endif // !LSST_MEAS_MULTIFIT_parallel_h_INCLUDED
@@ -173,8 +173,8 @@ public:
     /**
      *  Return the Prior object that corresponds to the configuration.
      *
-     *  This Prior class only supports evaluate() and evaluateDerivatives(), reflecting the fact
-     *  that we only intend to use it with a Optimizer, not a Sampler.
+     *  This Prior class only supports evaluate(), evaluateDerivatives(), and their log-domain
+     *  equivalents, reflecting the fact that we only intend to use it with a Optimizer, not a Sampler.
      */
     PTR(Prior) getPrior() const { return _prior; }
 
@@ -199,6 +199,9 @@ public:
     /**
      *  Perform an initial fit to a PSF image.
      *
+     *  Successive calls reuse the same Optimizer and model matrix memory, so apply() is not const,
+     *  and a PsfFitter must not be shared between threads.
+     *
      *  @param[in]  image       The image to fit, typically the result of Psf::computeKernelImage().  The
      *                          image's xy0 should be set such that the center of the PSF is at (0,0).
      *  @param[in]  noiseSigma  An estimate of the noise in the image.  As LSST PSF images are generally
@@ -212,12 +215,12 @@ public:
         afw::image::Image<Pixel> const & image,
         afw::geom::ellipses::Quadrupole const & moments,
         Scalar noiseSigma=-1
-    ) const;
+    );
     shapelet::MultiShapeletFunction apply(
         afw::image::Image<double> const & image,
         afw::geom::ellipses::Quadrupole const & moments,
         Scalar noiseSigma=-1
-    ) const {
+    ) {
         return apply(afw::image::Image<float>(image, true), moments, noiseSigma);
     }
     //@}
@@ -226,6 +229,8 @@ public:
     /**
      *  Perform a fit to a PSF image, using a previous fit as a starting point
      *
+     *  Like the other overloads, this reuses the Optimizer and memory from previous calls.
+     *
      *  @param[in]  image       The image to fit, typically the result of Psf::computeKernelImage().  The
      *                          image's xy0 should be set such that the center of the PSF is at (0,0).
      *  @param[in]  initial     The result of a previous call to apply(), using an identically-configured
@@ -239,12 +244,12 @@ public:
         afw::image::Image<Pixel> const & image,
         shapelet::MultiShapeletFunction const & initial,
         Scalar noiseSigma=-1
-    ) const;
+    );
     shapelet::MultiShapeletFunction apply(
         afw::image::Image<double> const & image,
         shapelet::MultiShapeletFunction const & initial,
         Scalar noiseSigma=-1
-    ) const {
+    ) {
         return apply(afw::image::Image<float>(image, true), initial, noiseSigma);
     }
     //@}
@@ -253,6 +258,8 @@ private:
     PsfFitterControl _ctrl;
     PTR(Model) _model;
     PTR(Prior) _prior;
+    PTR(OptimizerWorkspace) _workspace;  // reused by calls to apply()
+    PTR(Optimizer) _optimizer;           // reused by calls to apply(); created by the first one
 };
 
 /**
@@ -276,9 +283,16 @@ public:
         bool doApplyWeights=true
     ) const;
 
+    /// @copydoc Likelihood::clone
+    virtual PTR(Likelihood) clone() const;
+
     virtual ~MultiShapeletPsfLikelihood();
 
 private:
+
+    // Copy constructor used by clone(); shares data and weights, but not workspace.
+    MultiShapeletPsfLikelihood(MultiShapeletPsfLikelihood const & other);
+
     class Impl;
     boost::scoped_ptr<Impl> _impl;
 };
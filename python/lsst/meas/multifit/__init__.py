@@ -28,6 +28,7 @@ from .measureMulti import *
 from .fitRegion import *
 from .samplers import *
 from .optimizer import *
+from .coarseToFine import *
 from .models import *
 from .priors import *
 from . import psf
@@ -72,6 +72,12 @@ class BaseMeasureConfig(lsst.pex.config.Config):
         optional=True,
         doc="If not None, clip the catalog and process only this many objects (for fast-debug purposes)"
     )
+    batchSize = lsst.pex.config.Field(
+        dtype=int,
+        default=1,
+        doc=("Number of objects to fit together in lockstep, if the fitter supports it (via a runBatch"
+             " method); 1 fits each object separately")
+    )
     doRaise = lsst.pex.config.Field(
         dtype=bool,
         default=False,
@@ -220,7 +226,9 @@ class BaseMeasureTask(lsst.pipe.base.CmdLineTask):
             outCat = self.prepCatalog(inputs)
         if self.config.maxObjects is not None:
             outCat = outCat[:self.config.maxObjects]
-        if not self.config.prepOnly:
+        if not self.config.prepOnly and self.config.batchSize > 1 and hasattr(self.fitter, "runBatch"):
+            self.runBatches(inputs, outCat)
+        elif not self.config.prepOnly:
             for n, outRecord in enumerate(outCat):
                 if self.config.progressChunk > 0 and n % self.config.progressChunk == 0:
                     self.log.info("Fitting objects %d-%d of %d (currently %3.2f%%)"
@@ -244,6 +252,43 @@ class BaseMeasureTask(lsst.pipe.base.CmdLineTask):
         self.writeOutputs(dataRef, outCat)
         return lsst.pipe.base.Struct(outCat=outCat, inputs=inputs)
 
+    def runBatches(self, inputs, outCat):
+        """Fit all objects in the catalog in batches of config.batchSize, using fitter.runBatch().
+        """
+        batchSize = self.config.batchSize
+        for start in range(0, len(outCat), batchSize):
+            self.log.info("Fitting objects %d-%d of %d (currently %3.2f%%)"
+                          % (start+1, min(start+batchSize, len(outCat)), len(outCat),
+                             (100.0*start)/len(outCat)))
+            likelihoods = []
+            records = []
+            for n in range(start, min(start+batchSize, len(outCat))):
+                outRecord = outCat[n]
+                try:
+                    likelihoods.append(self.makeLikelihood(inputs, outRecord))
+                    records.append(outRecord)
+                except Exception as err:
+                    if self.config.doRaise:
+                        raise
+                    self.log.warn("Failure setting up object %d of %d with ID=%d:"
+                                  % (n, len(outCat), outRecord.getId()))
+                    self.log.warn(str(err))
+            # runBatch handles failures object-by-object, so one bad object can't spoil the batch
+            succeeded = self.fitter.runBatch(likelihoods, records, doRaise=self.config.doRaise)
+            for outRecord, success in zip(records, succeeded):
+                if not success:
+                    continue
+                try:
+                    nonlinear = outRecord[self.keys['fit.nonlinear']]
+                    nonlinear[:] = self.fitter.interpreter.computeNonlinearMean(outRecord)
+                    amplitudes = outRecord[self.keys['fit.amplitudes']]
+                    amplitudes[:] = self.fitter.interpreter.computeAmplitudeMean(outRecord)
+                except Exception as err:
+                    if self.config.doRaise:
+                        raise
+                    self.log.warn("Failure computing results for object with ID=%d:" % outRecord.getId())
+                    self.log.warn(str(err))
+
     def getPreviousTaskClass(self):
         """Return the Task class used to construct the previous catalog, if applicable."""
         raise NotImplementedError()
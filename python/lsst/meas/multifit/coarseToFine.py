@@ -0,0 +1,161 @@
+#!/usr/bin/env python
+#
+# LSST Data Management System
+# Copyright 2008-2013 LSST Corporation.
+#
+# This product includes software developed by the
+# LSST Project (http://www.lsst.org/).
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the LSST License Statement and
+# the GNU General Public License along with this program.  If not,
+# see <http://www.lsstcorp.org/LegalNotices/>.
+#
+
+import numpy
+
+import lsst.pex.config
+import lsst.pipe.base
+
+from . import multifitLib
+from .optimizer import OptimizerTask
+
+__all__ = ("CoarseOptimizerConfig", "CoarseToFineConfig", "CoarseToFineTask")
+
+@lsst.pex.config.wrap(multifitLib.OptimizerControl)
+class CoarseOptimizerConfig(lsst.pex.config.Config):
+    pass
+
+class CoarseToFineConfig(lsst.pex.config.Config):
+    binFactor = lsst.pex.config.Field(
+        dtype=int, default=2,
+        doc=("Number of pixels on a side of the blocks that are averaged to form the downsampled image "
+             "used in the coarse fit (typically 2 or 4); 1 to disable the coarse fit")
+        )
+    coarse = lsst.pex.config.ConfigField(
+        dtype=CoarseOptimizerConfig,
+        doc="Configuration of the optimizer used to fit the downsampled image"
+        )
+    fine = lsst.pex.config.ConfigurableField(
+        target=OptimizerTask,
+        doc="Subtask that does the full-resolution fit, starting from the result of the coarse fit"
+        )
+
+class CoarseToFineTask(lsst.pipe.base.Task):
+    """A 'fitter' subtask for Measure tasks that first fits a downsampled version of each object's
+    likelihood with a greedy optimizer, and then uses the result as the starting point for another
+    fitter subtask (an optimizer or sampler) at full resolution.
+
+    Most optimizer iterations take place far from the best-fit point, where the full resolution of
+    the data is not needed; doing those on a binned image reduces the total cost of model evaluation,
+    especially for large objects.  The coarse fit is skipped when warm-starting from a previous run,
+    and for likelihoods that cannot be downsampled: only UnitTransformedLikelihood can, and only if
+    it was constructed with the keepUnbinnedPixels control option set (likelihood.keepUnbinnedPixels
+    in the Measure task config), since otherwise it does not keep a copy of its unbinned pixels.
+    """
+
+    ConfigClass = CoarseToFineConfig
+
+    def __init__(self, schema, keys, model, prior, previous=None, **kwds):
+        lsst.pipe.base.Task.__init__(self, **kwds)
+        self.makeSubtask("fine", schema=schema, keys=keys, model=model, prior=prior,
+                         previous=(previous.fine if isinstance(previous, CoarseToFineTask) else previous))
+        self.interpreter = self.fine.interpreter
+        self.keys = keys
+        self.keys["coarse.flags"] = schema.addField(
+            "coarse.flags", type="Flag",
+            doc="set if the coarse fit failed, in which case the fine fit started from the initial parameters"
+            )
+        self.keys["coarse.nonlinear"] = schema.addField(
+            "coarse.nonlinear", type="ArrayD", size=model.getNonlinearDim(),
+            doc="nonlinear parameters found by the coarse fit, used as the starting point for the fine fit"
+            )
+        self.keys["coarse.amplitudes"] = schema.addField(
+            "coarse.amplitudes", type="ArrayD", size=model.getAmplitudeDim(),
+            doc="linear amplitudes found by the coarse fit, used as the starting point for the fine fit"
+            )
+        self.nonlinearDim = model.getNonlinearDim()
+        self.previous = previous
+        self.warnedNoDownsample = False
+
+    def makeSampleTable(self):
+        """Return a Table object that can be used to construct sample records.
+        """
+        return self.fine.makeSampleTable()
+
+    def initialize(self, record):
+        """Initialize an output record, setting any derived fields and record
+        attributes (i.e. samples or pdf) needed before calling run().
+
+        This method is not called when using a "warm start" from a previous fit.
+        """
+        self.fine.initialize(record)
+
+    def adaptPrevious(self, prevRecord, outRecord):
+        """Adapt a previous record (fit using self.previous as the fitter task), filling in the
+        fields and attributes of outRecord to put it in a state ready for run().
+        """
+        self.fine.adaptPrevious(prevRecord, outRecord)
+
+    def run(self, likelihood, record):
+        """Fit a downsampled version of the likelihood, then run the fine fitter subtask starting from
+        the result.
+
+        The record's initial parameters are left untouched; the coarse result is saved in the
+        'coarse.*' fields and passed directly to the fine fitter as its starting point.
+        """
+        if (self.config.binFactor > 1 and self.previous is None
+            and isinstance(likelihood, multifitLib.UnitTransformedLikelihood)
+            and self.canDownsample(likelihood) and self.runCoarse(likelihood, record)):
+            parameters = numpy.zeros(self.interpreter.getParameterDim(), dtype=multifitLib.Scalar)
+            self.interpreter.packParameters(record[self.keys["coarse.nonlinear"]],
+                                            record[self.keys["coarse.amplitudes"]],
+                                            parameters)
+            if isinstance(self.fine, OptimizerTask):
+                self.fine.run(likelihood, record, parameters=parameters)
+                return
+            # samplers build their proposal around the starting point in initialize()
+            self.fine.initialize(record, parameters=parameters)
+        self.fine.run(likelihood, record)
+
+    def canDownsample(self, likelihood):
+        """Return True if the given UnitTransformedLikelihood kept its unbinned pixels, warning (once)
+        if it did not.
+        """
+        if likelihood.canDownsample():
+            return True
+        if not self.warnedNoDownsample:
+            self.log.warn("Likelihood was not constructed with keepUnbinnedPixels=True; "
+                          "skipping coarse fits")
+            self.warnedNoDownsample = True
+        return False
+
+    def runCoarse(self, likelihood, record):
+        """Fit a downsampled version of the likelihood, save the result in the record's 'coarse.*'
+        fields, and return True if the fit succeeded.
+        """
+        coarse = multifitLib.UnitTransformedLikelihood(likelihood, self.config.binFactor)
+        parameters = numpy.concatenate(
+            [record[self.keys["initial.nonlinear"]], record[self.keys["initial.amplitudes"]]]
+            ).astype(multifitLib.Scalar)
+        objective = multifitLib.OptimizerObjective.makeFromLikelihood(coarse, self.interpreter.getPrior())
+        optimizer = multifitLib.Optimizer(objective, parameters, self.config.coarse.makeControl())
+        optimizer.run()
+        if optimizer.getState() & multifitLib.Optimizer.FAILED:
+            self.log.warn("Coarse fit failed (state=0x%x); starting fine fit from initial values"
+                          % optimizer.getState())
+            record.set(self.keys["coarse.flags"], True)
+            return False
+        parameters = optimizer.getParameters()
+        record[self.keys["coarse.nonlinear"]][:] = parameters[:self.nonlinearDim]
+        record[self.keys["coarse.amplitudes"]][:] = parameters[self.nonlinearDim:]
+        return True
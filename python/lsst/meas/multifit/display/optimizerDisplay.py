@@ -51,7 +51,10 @@ class OptimizerIterationDisplay(object):
         if self._objectiveValues is None:
             self._objectiveValues = numpy.zeros(self.grid.shape[:-1], dtype=float)
             self.parent.objective.fillObjectiveValueGrid(self.grid.reshape(-1, self.parent.ndim),
-                                                         self._objectiveValues.reshape(-1))
+                                                         self._objectiveValues.reshape(-1),
+                                                         numpy.zeros(0, dtype=float),
+                                                         numpy.zeros(0, dtype=float),
+                                                         self.parent.nThreads)
         return self._objectiveValues
 
     @property
@@ -65,7 +68,8 @@ class OptimizerIterationDisplay(object):
 
 class OptimizerDisplay(object):
 
-    def __init__(self, record, objective, steps=11):
+    def __init__(self, record, objective, steps=11, nThreads=1):
+        self.nThreads = nThreads
         self.recorder = multifitLib.OptimizerHistoryRecorder(record.getSamples().getSchema())
         # len(dimensions) == N in comments below
         self.dimensions = record.getInterpreter().getParameterNames()
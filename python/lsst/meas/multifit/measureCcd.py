@@ -57,6 +57,7 @@ class MeasureCcdTask(MeasureImageTask):
                     % dataRef.dataId
                     )
             applyMosaicResults(dataRef, calexp=inputs.exposure)
+            inputs.transformCache = self.makeTransformCache(inputs.exposure)
         return inputs
 
     @classmethod
@@ -43,6 +43,12 @@ class MeasureImageConfig(BaseMeasureConfig):
         default=0.1,
         doc="Minimum deconvolved initial radius in pixels"
     )
+    transformGridSpacing = lsst.pex.config.Field(
+        dtype=float,
+        default=64.0,
+        doc=("Spacing (in pixels) of the grid on which the exposure Wcs is linearized and cached for all "
+             "objects; <= 0 to linearize exactly at each object")
+    )
 
 class MeasureImageTask(BaseMeasureTask):
     """Driver class for S13-specific galaxy modeling work
@@ -62,23 +68,33 @@ class MeasureImageTask(BaseMeasureTask):
     def getPreviousConfig(self, butler):
         return butler.get(self._getConfigName(), tag=self.config.previous, immediate=True)
 
+    def makeTransformCache(self, exposure):
+        """Return a LocalUnitTransformCache for the given exposure's Wcs and Calib, to be shared by all
+        objects fit to it.  Must be recreated if the exposure's Wcs or Calib is replaced.
+        """
+        return multifitLib.LocalUnitTransformCache(multifitLib.UnitSystem(exposure),
+                                                   self.config.transformGridSpacing)
+
     def readInputs(self, dataRef):
         """Return a lsst.pipe.base.Struct containing the Exposure to fit and either a previous modelfits
         catalog (if config.doWarmStart) or the reference and source catalogs.
         """
         exposure = dataRef.get(self.dataPrefix + "calexp", immediate=True)
+        transformCache = self.makeTransformCache(exposure)
         dataset = self.dataPrefix + "modelfits"
         if self.config.previous is not None:
             prevCat = dataRef.get(self.dataPrefix + "modelfits", tag=self.config.previous, immediate=True)
             prevCat.setInterpreter(self.previous.fitter.interpreter)
             return lsst.pipe.base.Struct(
                 prevCat=prevCat,
-                exposure=exposure
+                exposure=exposure,
+                transformCache=transformCache
                 )
         else:
             return lsst.pipe.base.Struct(
                 srcCat=dataRef.get(self.dataPrefix + "src", immediate=True),
-                exposure=exposure
+                exposure=exposure,
+                transformCache=transformCache
                 )
 
     def prepCatalog(self, inputs):
@@ -92,7 +108,6 @@ class MeasureImageTask(BaseMeasureTask):
         outCat = multifitLib.ModelFitCatalog(self.makeTable())
         srcCat = inputs.srcCat
 
-        exposureUnits = multifitLib.UnitSystem(inputs.exposure)
         exposurePsf = inputs.exposure.getPsf()
         exposureCalib = inputs.exposure.getCalib()
 
@@ -120,7 +135,7 @@ class MeasureImageTask(BaseMeasureTask):
             # from the exposure to the parameter unit system
             nominalMag = exposureCalib.getMagnitude(srcRecord.getPsfFlux())
             units = self.makeUnitSystem(outRecord, outRecord.getCoord(), nominalMag)
-            transform = multifitLib.LocalUnitTransform(outRecord.getCoord(), exposureUnits, units)
+            transform = inputs.transformCache.toSystem(outRecord.getCoord(), units)
 
             # Start with the ellipse from the Shape and Centroid src slots (should refine this),
             # subtract the PSF moments (truncate radius as specified by config), and transform
@@ -170,7 +185,8 @@ class MeasureImageTask(BaseMeasureTask):
             inputs.exposure,
             record.getFootprint(),
             psf,
-            self.config.likelihood.makeControl()
+            self.config.likelihood.makeControl(),
+            inputs.transformCache
             )
 
     def writeOutputs(self, dataRef, outCat):
@@ -57,6 +57,12 @@ class MeasureMultiConfig(BaseMeasureConfig):
         doc="Apply meas_mosaic ubercal results to input calexps?",
         default=True
     )
+    transformGridSpacing = lsst.pex.config.Field(
+        dtype=float,
+        default=64.0,
+        doc=("Spacing (in pixels) of the grid on which each calexp Wcs is linearized and cached for all "
+             "objects; <= 0 to linearize exactly at each object")
+    )
 
     def validate(self):
         BaseMeasureConfig.validate(self)
@@ -92,6 +98,8 @@ class MeasureMultiTask(BaseMeasureTask):
           - exposureCat: catalog of ExposureRecords that determines which calexps can be used in the fitting
           - footprintWcs: Wcs of the Footprints attached to prevCat records
           - readInputExposure: a closure method, used to load individual calexp subimages
+          - transformCaches: dict of LocalUnitTransformCaches, keyed by ExposureRecord ID, filled
+            as calexps are first used
         """
         if self.config.usePreviousMultiFit:
             prevCat = dataRef.get(self.outputName, immediate=True)
@@ -126,7 +134,8 @@ class MeasureMultiTask(BaseMeasureTask):
             prevCat=prevCat,
             exposureCat=exposureCat,
             footprintWcs=footprintWcs,
-            readInputExposure=readInputExposure
+            readInputExposure=readInputExposure,
+            transformCaches={}
         )
 
     def prepCatalog(self, inputs):
@@ -166,7 +175,14 @@ class MeasureMultiTask(BaseMeasureTask):
             psfMoments = calexp.getPsf().computeShape(center)
             psf = psfFitter.apply(psfImage, psfMoments)
 
-            epochFootprint = multifitLib.EpochFootprint(calexpFootprint, calexp, psf)
+            # all objects fit to this calexp share a cache of its Wcs linearizations
+            transformCache = inputs.transformCaches.get(exposureRecord.getId())
+            if transformCache is None:
+                transformCache = multifitLib.LocalUnitTransformCache(multifitLib.UnitSystem(calexp),
+                                                                     self.config.transformGridSpacing)
+                inputs.transformCaches[exposureRecord.getId()] = transformCache
+
+            epochFootprint = multifitLib.EpochFootprint(calexpFootprint, calexp, psf, transformCache)
             epochFootprintList.append(epochFootprint)
 
         return MultiEpochLikelihood(
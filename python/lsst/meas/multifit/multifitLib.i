@@ -106,6 +106,8 @@ Basic routines to talk to lsst::meas::multifit classes
 %declareNumPyConverters(ndarray::Array<lsst::meas::multifit::Pixel,2,-2>);
 %declareNumPyConverters(ndarray::Array<lsst::meas::multifit::Pixel const,2,-1>);
 %declareNumPyConverters(ndarray::Array<lsst::meas::multifit::Pixel const,2,-2>);
+%declareNumPyConverters(ndarray::Array<lsst::meas::multifit::Pixel,3,3>);
+%declareNumPyConverters(ndarray::Array<int const,1,1>);
 %declareNumPyConverters(lsst::meas::multifit::Vector);
 %declareNumPyConverters(lsst::meas::multifit::Matrix);
 %declareNumPyConverters(Eigen::VectorXd);
@@ -131,6 +133,7 @@ Pixel = numpy.float32
 %shared_ptr(lsst::meas::multifit::Interpreter);
 %shared_ptr(lsst::meas::multifit::Likelihood);
 %shared_ptr(lsst::meas::multifit::EpochFootprint);
+%shared_ptr(lsst::meas::multifit::LocalUnitTransformCache);
 %shared_ptr(lsst::meas::multifit::UnitTransformedLikelihood);
 %shared_ptr(lsst::meas::multifit::Sampler);
 %shared_ptr(lsst::meas::multifit::SamplingObjective);
@@ -172,6 +175,17 @@ Pixel = numpy.float32
     ) const {
         return $self->evaluate(x);
     }
+    lsst::meas::multifit::Scalar evaluateLog(
+        lsst::meas::multifit::MixtureComponent const & component,
+        lsst::meas::multifit::Vector const & x
+    ) const {
+        return $self->evaluateLog(component, x);
+    }
+    lsst::meas::multifit::Scalar evaluateLog(
+        lsst::meas::multifit::Vector const & x
+    ) const {
+        return $self->evaluateLog(x);
+    }
 
     %pythoncode %{
         def __iter__(self):
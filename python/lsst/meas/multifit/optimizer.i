@@ -4,7 +4,10 @@
 
 %returnCopy(Optimizer::getControl)
 %returnCopy(Optimizer::getIterations)
+%returnCopy(Optimizer::getStatistics)
+%shared_ptr(lsst::meas::multifit::OptimizerWorkspace)
 %shared_ptr(lsst::meas::multifit::OptimizerObjective)
+%shared_ptr(lsst::meas::multifit::VariableProjectionOptimizerObjective)
 %shared_ptr(lsst::meas::multifit::OptimizerInterpreter)
 
 %include "lsst/meas/multifit/optimizer.h"
@@ -23,6 +26,7 @@
         Objective = OptimizerObjective
         Control = OptimizerControl
         HistoryRecorder = OptimizerHistoryRecorder
+        HistoryBuffer = OptimizerHistoryBuffer
 
         def getConfig(self):
             config = self.ConfigClass()
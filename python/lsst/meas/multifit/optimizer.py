@@ -26,8 +26,10 @@ import numpy
 import lsst.pex.config
 import lsst.pipe.base
 import lsst.afw.table
+import lsst.afw.math
 
 from . import multifitLib
+from .samplers import AdaptiveImportanceSamplerTask
 
 __all__ = ("OptimizerConfig", "OptimizerTask")
 
@@ -41,6 +43,72 @@ class OptimizerConfig(lsst.pex.config.Config):
         dtype=bool, default=True,
         doc="Whether to save derivatives with history (ignored if doRecordHistory is False)"
         )
+    historyBufferSize = lsst.pex.config.Field(
+        dtype=int, default=0,
+        doc=("If > 0, record history into a preallocated buffer holding this many of the most recent "
+             "iterations, and only convert it to the samples table for every historySampleInterval-th "
+             "object; if 0, record history directly into the samples table for every object "
+             "(ignored if doRecordHistory is False)")
+        )
+    historySampleInterval = lsst.pex.config.Field(
+        dtype=int, default=1,
+        doc="Save buffered history for only one in every this many objects (ignored if historyBufferSize==0)"
+        )
+    doWarmStart = lsst.pex.config.Field(
+        dtype=bool, default=False,
+        doc=("Whether to start from the best-fit parameters and (inverse) covariance of a single-Gaussian "
+             "pdf already attached to the record (e.g. from a previous optimizer run), instead of the "
+             "initial parameters.  Off by default, so a rerun reproduces a cold-started fit unless "
+             "warm starts are requested explicitly")
+        )
+    warmStartTrustRadiusFactor = lsst.pex.config.Field(
+        dtype=float, default=1.0,
+        doc=("When warm-starting, the initial trust radius is this factor times the square root of the "
+             "trace of the previous covariance matrix")
+        )
+    nStarts = lsst.pex.config.Field(
+        dtype=int, default=1,
+        doc=("Number of starting points for each (cold-started) fit; if > 1, the initial parameters are "
+             "used for the first start, and the nonlinear parameters of the rest are offset from them "
+             "according to a Latin hypercube design")
+        )
+    multiStartSpacing = lsst.pex.config.Field(
+        dtype=float, default=0.8,
+        doc="Maximum offset of the nonlinear parameters of the additional starts from the initial values"
+        )
+    multiStartAbandonThreshold = lsst.pex.config.Field(
+        dtype=float, default=10.0,
+        doc="Abandon starts whose objective is worse than the best start's by more than this"
+        )
+    multiStartThreads = lsst.pex.config.Field(
+        dtype=int, default=1,
+        doc=("Number of threads used to step multiple starts; values > 1 require a thread-safe prior "
+             "(MixturePrior is not)")
+        )
+    multiStartSeed = lsst.pex.config.Field(
+        dtype=int, default=1,
+        doc="Seed for the random number generator used to generate the multi-start design"
+        )
+    batchThreads = lsst.pex.config.Field(
+        dtype=int, default=1,
+        doc=("Number of threads used to step the objects in a batch (see runBatch); values > 1 require a "
+             "thread-safe prior (MixturePrior is not)")
+        )
+    modelCacheSize = lsst.pex.config.Field(
+        dtype=int, default=1,
+        doc=("Number of model matrices (keyed on the nonlinear parameters) cached by the objective; "
+             "nonlinearDim + 2 is enough to avoid recomputing the model at the current point after "
+             "numerical derivatives")
+        )
+    doRecordStatistics = lsst.pex.config.Field(
+        dtype=bool, default=False,
+        doc="Whether to save optimizer counters and timings (see OptimizerStatistics) in the modelfits table"
+        )
+    doProjectAmplitudes = lsst.pex.config.Field(
+        dtype=bool, default=False,
+        doc=("Whether to first optimize only the nonlinear parameters, solving for the amplitudes at each "
+             "point (variable projection), before a final optimization of all parameters")
+        )
 
 class OptimizerTask(lsst.pipe.base.Task):
     """A 'fitter' subtask for Measure tasks that uses a greedy optimizer.
@@ -48,6 +116,24 @@ class OptimizerTask(lsst.pipe.base.Task):
 
     ConfigClass = OptimizerConfig
 
+    STATISTICS_FIELDS = (
+        ("residualEvaluations", "number of residual evaluations, including those for derivatives"),
+        ("jacobianEvaluations", "number of times the Jacobian was computed"),
+        ("broydenUpdates", "number of times the Jacobian was updated with a Broyden secant step"),
+        ("modelCacheHits", "number of residual evaluations that reused a cached model matrix"),
+        ("modelCacheMisses", "number of residual evaluations that computed a new model matrix"),
+        ("outerIterations", "number of optimizer steps attempted"),
+        ("innerIterations", "number of trust region subproblems solved"),
+        ("rejectedSteps", "number of trial steps rejected"),
+        ("conjugateGradientIterations", "number of truncated conjugate gradient iterations"),
+        )
+
+    TIMING_FIELDS = (
+        ("modelTime", "wall time spent computing residuals and their derivatives"),
+        ("priorTime", "wall time spent computing the prior and its derivatives"),
+        ("trustRegionTime", "wall time spent solving trust region subproblems"),
+        )
+
     def __init__(self, schema, keys, model, prior, previous=None, **kwds):
         lsst.pipe.base.Task.__init__(self, **kwds)
         # n.b. schema argument is for modelfits catalog; self.sampleSchema is for sample catalog
@@ -61,14 +147,32 @@ class OptimizerTask(lsst.pipe.base.Task):
                                                  doc="State flags transferred directly from Optimizer")
         self.keys["fit.objective"] = schema.addField("objective", type=float,
                                                      doc="objective (-ln likelihood*prior) at fit.parameters")
+        if self.config.doRecordStatistics:
+            for name, doc in self.STATISTICS_FIELDS:
+                self.keys["fit.stats." + name] = schema.addField("fit.stats." + name, type=int, doc=doc)
+            for name, doc in self.TIMING_FIELDS:
+                self.keys["fit.stats." + name] = schema.addField("fit.stats." + name, type=float,
+                                                                 doc=doc, units="seconds")
         if self.config.doRecordHistory:
             self.recorder = multifitLib.OptimizerHistoryRecorder(
                 self.sampleSchema, model, self.config.doRecordDerivatives
                 )
         else:
             self.recorder = None
-        if previous is not None:
-            self.log.warn("Warm-starting optimizer runs is current not supported; starting from ref values")
+        if self.recorder and self.config.historyBufferSize > 0:
+            self.historyBuffer = multifitLib.OptimizerHistoryBuffer(
+                self.interpreter.getParameterDim(), self.config.historyBufferSize,
+                self.config.doRecordDerivatives
+                )
+        else:
+            self.historyBuffer = None
+        self.historyCount = 0
+        if self.config.nStarts > 1:
+            self.rng = lsst.afw.math.Random("MT19937", self.config.multiStartSeed)
+        self.previous = previous
+        # memory reused across calls to run(), to avoid reallocating for every object
+        self.workspace = multifitLib.OptimizerWorkspace()
+        self.optimizer = None
 
     def makeSampleTable(self):
         """Return a Table object that can be used to construct sample records.
@@ -86,24 +190,228 @@ class OptimizerTask(lsst.pipe.base.Task):
     def adaptPrevious(self, prevRecord, outRecord):
         """Adapt a previous record (fit using self.previous as the fitter task), filling in the
         fields and attributes of outRecord to put it in a state ready for run().
+
+        The previous best-fit parameters become the new initial parameters, and the previous pdf is
+        kept so run() can use it to warm-start the optimizer (see OptimizerConfig.doWarmStart).
         """
-        pass
+        nonlinear = prevRecord.get(self.previous.keys["fit.nonlinear"])
+        amplitudes = prevRecord.get(self.previous.keys["fit.amplitudes"])
+        if numpy.isfinite(nonlinear).all() and numpy.isfinite(amplitudes).all():
+            outRecord[self.keys["initial.nonlinear"]][:] = nonlinear
+            outRecord[self.keys["initial.amplitudes"]][:] = amplitudes
+        outRecord.setPdf(prevRecord.getPdf())
+
+    def getWarmStart(self, record, parameters):
+        """Return the initial Hessian and trust radius for a warm start from the pdf attached to record,
+        updating the given parameter array in-place to the pdf mean.
+
+        If a warm start is not possible or not enabled, returns an empty Hessian and a zero trust radius,
+        which tells the optimizer to start cold.
+        """
+        n = parameters.size
+        cold = (numpy.zeros((0, 0), dtype=multifitLib.Scalar), 0.0)
+        if not self.config.doWarmStart:
+            return cold
+        pdf = record.getPdf()
+        if pdf is None or len(pdf) != 1 or pdf.getDimension() != n:
+            return cold
+        mean = self.interpreter.computeParameterMean(record)
+        covariance = self.interpreter.computeParameterCovariance(record, mean)
+        if not (numpy.isfinite(mean).all() and numpy.isfinite(covariance).all()):
+            return cold
+        try:
+            hessian = numpy.linalg.inv(covariance)
+        except numpy.linalg.LinAlgError:
+            return cold
+        parameters[:] = mean
+        trustRadius = self.config.warmStartTrustRadiusFactor * numpy.trace(covariance)**0.5
+        return hessian, trustRadius
 
-    def run(self, likelihood, record):
+    def run(self, likelihood, record, parameters=None):
         """Do the actual fitting, using the given likelihood, update the 'pdf' and 'samples' attributes,
         and save best-fit values in the 'fit.parameters' field.
+
+        If a parameter array is given, the fit starts there instead of at the record's 'initial.*' fields
+        (this is how CoarseToFineTask passes on the result of its coarse fit).
         """
-        parameters = numpy.zeros(self.interpreter.getParameterDim(), dtype=multifitLib.Scalar)
-        self.interpreter.packParameters(record[self.keys["initial.nonlinear"]],
-                                        record[self.keys["initial.amplitudes"]],
-                                        parameters)
-        objective = multifitLib.OptimizerObjective.makeFromLikelihood(likelihood, self.interpreter.getPrior())
-        optimizer = multifitLib.Optimizer(objective, parameters, self.config.makeControl())
-        if self.recorder:
-            optimizer.run(self.recorder, record.getSamples())
+        if parameters is None:
+            parameters = numpy.zeros(self.interpreter.getParameterDim(), dtype=multifitLib.Scalar)
+            self.interpreter.packParameters(record[self.keys["initial.nonlinear"]],
+                                            record[self.keys["initial.amplitudes"]],
+                                            parameters)
         else:
-            optimizer.run()
+            parameters = numpy.array(parameters, dtype=multifitLib.Scalar)
+        hessian, trustRadius = self.getWarmStart(record, parameters)
+        isColdStart = trustRadius <= 0.0
+        if self.config.doProjectAmplitudes and isColdStart:
+            trustRadius = self.projectAmplitudes(likelihood, parameters)
+        if self.config.nStarts > 1 and isColdStart:
+            optimizer = self.runMultiStart(likelihood, parameters)
+        else:
+            optimizer = self.runSingleStart(likelihood, record, parameters, hessian, trustRadius)
         self.interpreter.attachPdf(record, optimizer)
         record.set(self.keys['fit.flags'], bool(optimizer.getState() & multifitLib.Optimizer.FAILED))
         record.set(self.keys['fit.state'], optimizer.getState())
         record.set(self.keys['fit.objective'], optimizer.getObjectiveValue())
+        self.recordStatistics(record, optimizer)
+
+    def runSingleStart(self, likelihood, record, parameters, hessian, trustRadius):
+        """Run the optimizer once, starting from the given parameters, and return it.
+
+        The optimizer (and the memory it holds) is reused by subsequent calls.
+        """
+        objective = multifitLib.OptimizerObjective.makeFromLikelihood(likelihood, self.interpreter.getPrior(),
+                                                                      self.workspace,
+                                                                      self.config.modelCacheSize)
+        if self.optimizer is None:
+            self.optimizer = multifitLib.Optimizer(objective, parameters, self.config.makeControl(),
+                                                   hessian, trustRadius)
+        else:
+            self.optimizer.reset(objective, parameters, hessian, trustRadius)
+        optimizer = self.optimizer
+        if self.historyBuffer:
+            self.historyBuffer.clear()
+            optimizer.run(self.historyBuffer)
+            if self.historyCount % self.config.historySampleInterval == 0:
+                self.historyBuffer.copyTo(self.recorder, record.getSamples())
+            self.historyCount += 1
+        elif self.recorder:
+            optimizer.run(self.recorder, record.getSamples())
+        else:
+            optimizer.run()
+        return optimizer
+
+    def runMultiStart(self, likelihood, parameters):
+        """Run the optimizer from config.nStarts starting points around the given parameters, and
+        return the Optimizer for the best one.
+
+        History is not recorded for multi-start fits.  If all starts fail, the first start's optimizer
+        is returned.
+        """
+        nonlinearDim = likelihood.getNonlinearDim()
+        nThreads = self.config.multiStartThreads
+        likelihoods = [likelihood]
+        for i in range(1, self.config.nStarts):
+            # each thread needs its own likelihood, as they hold internal workspace
+            clone = likelihood.clone() if nThreads > 1 else likelihood
+            if clone is None:
+                self.log.warn("Likelihood cannot be cloned; running multiple starts serially")
+                nThreads = 1
+                clone = likelihood
+            likelihoods.append(clone)
+        multiStart = multifitLib.MultiStartOptimizer(parameters.size, self.config.makeControl(),
+                                                     self.config.multiStartAbandonThreshold, nThreads)
+        design = AdaptiveImportanceSamplerTask.makeLatinCube(self.rng, self.config.nStarts - 1, nonlinearDim)
+        for i, startLikelihood in enumerate(likelihoods):
+            start = parameters.copy()
+            if i > 0:
+                start[:nonlinearDim] += design[i - 1,:] * self.config.multiStartSpacing
+            objective = multifitLib.OptimizerObjective.makeFromLikelihood(startLikelihood,
+                                                                          self.interpreter.getPrior(),
+                                                                          self.config.modelCacheSize)
+            multiStart.add(objective, start)
+        # keep the MultiStartOptimizer alive until the next call, as it owns the Optimizer we return
+        self.multiStart = multiStart
+        best = multiStart.run()
+        self.log.logdebug("Multi-start fit chose start %d of %d; %d abandoned"
+                          % (best, multiStart.getSize(), multiStart.getAbandonedCount()))
+        if best < 0:
+            return multiStart.getOptimizer(0)
+        return multiStart.getBest()
+
+    def runBatch(self, likelihoods, records, doRaise=False):
+        """Fit several objects at once, stepping their optimizers in lockstep.
+
+        This is equivalent to calling run() on each (likelihood, record) pair, but drives all of
+        the fits from a single loop (optionally spread over config.batchThreads threads), retiring
+        objects from the batch as they converge.  History recording is not supported in batch mode,
+        and each object gets only a single start.
+
+        Failures are handled per object: unless doRaise is True, an exception while setting up or
+        fitting one object just sets that record's fit.flags (with fit.state set to
+        Optimizer.FAILED_EXCEPTION) and is logged, and the rest of the batch is unaffected.
+
+        Returns a list of bools indicating which records were fit successfully (i.e. have a pdf
+        attached, though fit.flags may still be set if the optimizer did not converge).
+        """
+        if self.recorder:
+            raise lsst.pipe.base.TaskError("Optimizer history cannot be recorded in batch mode")
+        batch = multifitLib.BatchOptimizer(self.interpreter.getParameterDim(), self.config.makeControl(),
+                                           self.config.batchThreads)
+        indices = []  # index of each record's problem in the batch, or None if it could not be added
+        for likelihood, record in zip(likelihoods, records):
+            try:
+                parameters = numpy.zeros(self.interpreter.getParameterDim(), dtype=multifitLib.Scalar)
+                self.interpreter.packParameters(record[self.keys["initial.nonlinear"]],
+                                                record[self.keys["initial.amplitudes"]],
+                                                parameters)
+                hessian, trustRadius = self.getWarmStart(record, parameters)
+                if self.config.doProjectAmplitudes and trustRadius <= 0.0:
+                    trustRadius = self.projectAmplitudes(likelihood, parameters)
+                objective = multifitLib.OptimizerObjective.makeFromLikelihood(likelihood,
+                                                                              self.interpreter.getPrior(),
+                                                                              self.config.modelCacheSize)
+                indices.append(batch.add(objective, parameters, hessian, trustRadius))
+            except Exception as err:
+                if doRaise:
+                    raise
+                self.log.warn("Failure setting up batch fit for object with ID=%d: %s"
+                              % (record.getId(), err))
+                indices.append(None)
+        batch.run()
+        succeeded = []
+        for index, record in zip(indices, records):
+            try:
+                if index is None:
+                    raise RuntimeError("object was not added to the batch")
+                optimizer = batch.getOptimizer(index)  # raises if the objective threw when it was added
+                self.interpreter.attachPdf(record, optimizer)
+                record.set(self.keys['fit.flags'], bool(optimizer.getState() & multifitLib.Optimizer.FAILED))
+                record.set(self.keys['fit.state'], optimizer.getState())
+                record.set(self.keys['fit.objective'], optimizer.getObjectiveValue())
+                self.recordStatistics(record, optimizer)
+                succeeded.append(True)
+            except Exception as err:
+                if doRaise:
+                    raise
+                self.log.warn("Failure in batch fit for object with ID=%d: %s" % (record.getId(), err))
+                record.set(self.keys['fit.flags'], True)
+                record.set(self.keys['fit.state'], multifitLib.Optimizer.FAILED_EXCEPTION)
+                succeeded.append(False)
+        return succeeded
+
+    def recordStatistics(self, record, optimizer):
+        """Copy the counters and timings of the given Optimizer to record, if doRecordStatistics is True.
+        """
+        if not self.config.doRecordStatistics:
+            return
+        statistics = optimizer.getStatistics()
+        for name, doc in self.STATISTICS_FIELDS + self.TIMING_FIELDS:
+            record.set(self.keys["fit.stats." + name], getattr(statistics, name))
+
+    def projectAmplitudes(self, likelihood, parameters):
+        """Optimize the nonlinear parameters only, solving for the amplitudes at each point, and
+        update the given full parameter vector in-place with the result.
+
+        The full optimizer is still run afterwards, both to polish the result and to compute the
+        Hessian of all parameters needed by attachPdf.  It is warm-started from the projected
+        solution: it begins there, with the trust radius returned here (the projected optimizer's
+        final trust radius), rather than growing it again from trustRegionInitialSize.  It still
+        starts from the Gauss-Newton Hessian of all parameters, as the projected Hessian only
+        involves the nonlinear parameters.  Returns zero (i.e. the default initial trust radius) if the
+        projected fit fails or its trust region collapsed.
+        """
+        nonlinearDim = likelihood.getNonlinearDim()
+        objective = multifitLib.VariableProjectionOptimizerObjective(likelihood, self.interpreter.getPrior())
+        optimizer = multifitLib.Optimizer(objective, parameters[:nonlinearDim], self.config.makeControl())
+        optimizer.run()
+        if optimizer.getState() & multifitLib.Optimizer.FAILED:
+            self.log.warn("Projected optimizer failed (state=0x%x); starting full fit from initial values"
+                          % optimizer.getState())
+            return 0.0
+        parameters[:nonlinearDim] = optimizer.getParameters()
+        objective.computeAmplitudes(optimizer.getParameters(), parameters[nonlinearDim:])
+        if optimizer.getState() & multifitLib.Optimizer.CONVERGED_TR_SMALL:
+            # a collapsed trust region would stop the full fit before it could adjust the amplitudes
+            return 0.0
+        return optimizer.getTrustRadius()
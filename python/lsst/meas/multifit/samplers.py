@@ -155,16 +155,20 @@ class AdaptiveImportanceSamplerTask(lsst.pipe.base.Task):
         # easy
         return design
 
-    def initialize(self, outRecord):
+    def initialize(self, outRecord, parameters=None):
         """Initialize an output record, setting any derived fields and record
         attributes (i.e. samples or pdf) needed before calling run().
 
+        The initial proposal is centered on the given parameter array, or on the record's
+        'initial.*' fields if none is given.
+
         This method is not called when using a "warm start" from a previous fit.
         """
-        parameters = numpy.zeros(self.interpreter.getParameterDim(), dtype=multifitLib.Scalar)
-        self.interpreter.packParameters(outRecord[self.keys['initial.nonlinear']],
-                                        outRecord[self.keys['initial.amplitudes']],
-                                        parameters)
+        if parameters is None:
+            parameters = numpy.zeros(self.interpreter.getParameterDim(), dtype=multifitLib.Scalar)
+            self.interpreter.packParameters(outRecord[self.keys['initial.nonlinear']],
+                                            outRecord[self.keys['initial.amplitudes']],
+                                            parameters)
         components = multifitLib.Mixture.ComponentList()
         sigma = numpy.identity(parameters.size, dtype=float) * self.config.initialSigma**2
         design = self.makeLatinCube(self.rng, self.config.nComponents, parameters.size)
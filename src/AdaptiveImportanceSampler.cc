@@ -130,10 +130,19 @@ void AdaptiveImportanceSampler::run(
             proposal->draw(*_rng, parameters);
             ndarray::Array<Scalar,1,1> probability = ndarray::allocate(ctrl.nSamples);
             proposal->evaluate(parameters, probability);
+            // evaluate the objective for all samples at once, then keep only those with finite values
+            afw::table::BaseCatalog batch(samples.getTable());
+            batch.reserve(ctrl.nSamples);
             for (int k = 0; k < ctrl.nSamples; ++k) {
-                PTR(afw::table::BaseRecord) record = samples.addNew();
-                double objectiveValue = objective(parameters[k], *record);
+                batch.addNew();
+            }
+            ndarray::Array<Scalar,1,1> objectiveValues = ndarray::allocate(ctrl.nSamples);
+            objective.evaluate(parameters, batch, objectiveValues);
+            for (int k = 0; k < ctrl.nSamples; ++k) {
+                PTR(afw::table::BaseRecord) record = batch.get(k);
+                double objectiveValue = objectiveValues[k];
                 if (utils::isfinite(objectiveValue)) {
+                    samples.push_back(record);
                     subSamples.push_back(record);
                     record->set(_parametersKey, parameters[k]);
                     record->set(_objectiveKey, objectiveValue);
@@ -145,8 +154,6 @@ void AdaptiveImportanceSampler::run(
                     // for numerical reasons, in the first pass, we set w_i = ln(p_i/q_i);
                     // note that proposal[i] == -ln(q_i) and objective[i] == -ln(p_i)
                     record->set(_weightKey, record->get(_proposalKey) - record->get(_objectiveKey));
-                } else {
-                    samples.pop_back();
                 }
             }
             if (samples.empty()) {
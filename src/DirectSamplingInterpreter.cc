@@ -21,6 +21,8 @@
  * see <http://www.lsstcorp.org/LegalNotices/>.
  */
 
+#include <algorithm>
+
 #include "ndarray/eigen.h"
 
 #include "lsst/meas/multifit/DirectSamplingInterpreter.h"
@@ -40,26 +42,69 @@ public:
         int np = _likelihood->getNonlinearDim();
         ndarray::Array<Scalar const,1,1> nonlinear
             = parameters[ndarray::view(0, np)];
-        ndarray::Array<Scalar const,1,1> amplitudes
-            = parameters[ndarray::view(np, np + _likelihood->getAmplitudeDim())];
         _likelihood->computeModelMatrix(_modelMatrix, nonlinear);
-        Scalar chiSq = (
-            _likelihood->getData().asEigen() - _modelMatrix.asEigen() * amplitudes.asEigen().cast<Pixel>()
-        ).squaredNorm();
-        if (getInterpreter()->getPrior()) {
-            chiSq -= std::log(getInterpreter()->getPrior()->evaluate(nonlinear, amplitudes));
+        return _evaluate(parameters, _modelMatrix);
+    }
+
+    virtual void evaluate(
+        ndarray::Array<Scalar const,2,1> const & parameters,
+        afw::table::BaseCatalog & samples,
+        ndarray::Array<Scalar,1,1> const & values
+    ) const {
+        int np = _likelihood->getNonlinearDim();
+        int const n = parameters.getSize<0>();
+        if (_modelMatrices.isEmpty()) {
+            _modelMatrices = ndarray::allocate(
+                BATCH_SIZE, _likelihood->getAmplitudeDim(), _likelihood->getDataDim()
+            );
+        }
+        for (int begin = 0; begin < n; begin += BATCH_SIZE) {
+            int end = std::min(begin + BATCH_SIZE, n);
+            _likelihood->computeModelMatrices(
+                _modelMatrices[ndarray::view(0, end - begin)],
+                parameters[ndarray::view(begin, end)(0, np)]
+            );
+            for (int k = begin; k < end; ++k) {
+                values[k] = _evaluate(parameters[k], _modelMatrices[k - begin].transpose());
+            }
         }
-        return chiSq;
     }
 
     DirectSamplingObjective(
         PTR(SamplingInterpreter) interpreter,
         PTR(Likelihood) likelihood
     ) :
-        SamplingObjective(interpreter, likelihood)
+        SamplingObjective(interpreter, likelihood),
+        _modelMatrix(ndarray::allocate(likelihood->getDataDim(), likelihood->getAmplitudeDim()))
     {}
 
 private:
+
+    // maximum number of points passed to Likelihood::computeModelMatrices at once, which sets
+    // the number of model matrices held in memory by evaluate()
+    static int const BATCH_SIZE = 8;
+
+    // Compute the objective from the model matrix at the nonlinear part of the given parameters.
+    Scalar _evaluate(
+        ndarray::Array<Scalar const,1,1> const & parameters,
+        ndarray::Array<Pixel,2,-1> const & modelMatrix
+    ) const {
+        int np = _likelihood->getNonlinearDim();
+        ndarray::Array<Scalar const,1,1> nonlinear
+            = parameters[ndarray::view(0, np)];
+        ndarray::Array<Scalar const,1,1> amplitudes
+            = parameters[ndarray::view(np, np + _likelihood->getAmplitudeDim())];
+        Scalar chiSq = (
+            _likelihood->getData().asEigen() - modelMatrix.asEigen() * amplitudes.asEigen().cast<Pixel>()
+        ).squaredNorm();
+        if (getInterpreter()->getPrior()) {
+            chiSq -= getInterpreter()->getPrior()->evaluateLog(nonlinear, amplitudes);
+        }
+        return chiSq;
+    }
+
+    ndarray::Array<Pixel,2,-1> _modelMatrix;
+    mutable ndarray::Array<Pixel,3,3> _modelMatrices; // allocated on first use by evaluate()
     ndarray::Array<Pixel,1,1> _residuals;
 };
 
@@ -0,0 +1,124 @@
+// -*- lsst-c++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2008-2013 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "ndarray.h"
+#include "ndarray/eigen.h"
+
+#include "lsst/meas/multifit/Likelihood.h"
+
+namespace lsst { namespace meas { namespace multifit {
+
+Scalar Likelihood::computeNumDiffStep(Scalar parameter) {
+    // The model matrix is only computed in single precision, so we scale the step to the square root
+    // of the single-precision epsilon, which balances truncation and round-off error.
+    static Scalar const REL_STEP = std::sqrt(std::numeric_limits<Pixel>::epsilon());
+    return REL_STEP * std::max(std::abs(parameter), 1.0);
+}
+
+void Likelihood::computeModelMatrices(
+    ndarray::Array<Pixel,3,3> const & modelMatrices,
+    ndarray::Array<Scalar const,2,1> const & nonlinear,
+    bool doApplyWeights
+) const {
+    LSST_THROW_IF_NE(
+        modelMatrices.getSize<0>(), nonlinear.getSize<0>(),
+        pex::exceptions::LengthError,
+        "Number of model matrices (%d) does not match number of nonlinear parameter vectors (%d)"
+    );
+    for (int k = 0; k < nonlinear.getSize<0>(); ++k) {
+        computeModelMatrix(modelMatrices[k].transpose(), nonlinear[k], doApplyWeights);
+    }
+}
+
+void Likelihood::computeModelMatrixDerivatives(
+    ndarray::Array<Pixel,3,3> const & derivatives,
+    ndarray::Array<Scalar const,1,1> const & nonlinear,
+    bool doApplyWeights,
+    ndarray::Array<Pixel const,2,-1> const & modelMatrix
+) const {
+    int const nonlinearDim = getNonlinearDim();
+    // if we weren't given the model matrix at the unperturbed point, it goes in modelMatrices[0],
+    // and the point perturbed in parameter k goes in modelMatrices[k + offset]
+    int const offset = modelMatrix.isEmpty() ? 1 : 0;
+    ndarray::Array<Scalar,2,2> points = ndarray::allocate(nonlinearDim + offset, nonlinearDim);
+    ndarray::Array<Pixel,3,3> modelMatrices
+        = ndarray::allocate(nonlinearDim + offset, getAmplitudeDim(), getDataDim());
+    Vector steps(nonlinearDim);
+    for (int k = 0; k < nonlinearDim + offset; ++k) {
+        points[k] = nonlinear;
+    }
+    for (int k = 0; k < nonlinearDim; ++k) {
+        points[k + offset][k] += computeNumDiffStep(nonlinear[k]);
+        steps[k] = points[k + offset][k] - nonlinear[k]; // make sure the step is exactly representable
+    }
+    computeModelMatrices(modelMatrices, points, doApplyWeights);
+    for (int k = 0; k < nonlinearDim; ++k) {
+        if (offset) {
+            derivatives[k].asEigen() = modelMatrices[k + 1].asEigen() - modelMatrices[0].asEigen();
+        } else {
+            derivatives[k].asEigen() = modelMatrices[k].asEigen() - modelMatrix.asEigen().transpose();
+        }
+        derivatives[k].asEigen() *= static_cast<Pixel>(1.0 / steps[k]);
+    }
+}
+
+void Likelihood::computeNormalEquations(
+    ndarray::Array<Scalar const,1,1> const & nonlinear,
+    ndarray::Array<Scalar,2,2> const & hessian,
+    ndarray::Array<Scalar,1,1> const & gradient
+) const {
+    ndarray::Array<Pixel,2,-1> modelMatrix = ndarray::allocate(getDataDim(), getAmplitudeDim());
+    computeModelMatrix(modelMatrix, nonlinear);
+    hessian.asEigen().setZero();
+    hessian.asEigen().selfadjointView<Eigen::Lower>().rankUpdate(
+        modelMatrix.asEigen().adjoint().cast<Scalar>()
+    );
+    hessian.asEigen() = hessian.asEigen().selfadjointView<Eigen::Lower>();
+    gradient.asEigen() = modelMatrix.asEigen().adjoint().cast<Scalar>() * _data.asEigen().cast<Scalar>();
+}
+
+void Likelihood::computeNormalEquationsBatch(
+    ndarray::Array<Scalar const,2,1> const & nonlinear,
+    ndarray::Array<Scalar,3,3> const & hessians,
+    ndarray::Array<Scalar,2,2> const & gradients
+) const {
+    LSST_THROW_IF_NE(
+        hessians.getSize<0>(), nonlinear.getSize<0>(),
+        pex::exceptions::LengthError,
+        "Number of Hessians (%d) does not match number of nonlinear parameter vectors (%d)"
+    );
+    LSST_THROW_IF_NE(
+        gradients.getSize<0>(), nonlinear.getSize<0>(),
+        pex::exceptions::LengthError,
+        "Number of gradients (%d) does not match number of nonlinear parameter vectors (%d)"
+    );
+    for (int k = 0; k < nonlinear.getSize<0>(); ++k) {
+        computeNormalEquations(nonlinear[k], hessians[k], gradients[k]);
+    }
+}
+
+}}} // namespace lsst::meas::multifit
@@ -21,6 +21,8 @@
  * see <http://www.lsstcorp.org/LegalNotices/>.
  */
 
+#include <algorithm>
+
 #include "boost/math/special_functions/round.hpp"
 
 #include "ndarray/eigen.h"
@@ -40,27 +42,37 @@ public:
         ndarray::Array<Scalar const,1,1> const & parameters,
         afw::table::BaseRecord & sample
     ) const {
-        _likelihood->computeModelMatrix(_modelMatrix, parameters);
-        Matrix hessian = Matrix::Zero(_likelihood->getAmplitudeDim(), _likelihood->getAmplitudeDim());
-        hessian.selfadjointView<Eigen::Lower>().rankUpdate(_modelMatrix.asEigen().adjoint().cast<Scalar>());
-        Vector gradient
-            = -(_modelMatrix.asEigen().adjoint() * _likelihood->getData().asEigen()).cast<Scalar>();
-        ArrayKey nestedKey = static_cast<MarginalSamplingInterpreter &>(*getInterpreter()).getNestedKey();
-        ndarray::Array<Scalar,1,1> nested = sample[nestedKey];
-        int const n = _likelihood->getAmplitudeDim();
-        for (int i = 0, k = n; i < n; ++i) {
-            nested[i] = gradient[i];
-            for (int j = 0; j <= i; ++j, ++k) {
-                nested[k] = hessian(i, j);
+        _likelihood->computeNormalEquations(parameters, _hessians[0], _gradients[0]);
+        return _evaluate(parameters, _hessians[0], _gradients[0], sample);
+    }
+
+    virtual void evaluate(
+        ndarray::Array<Scalar const,2,1> const & parameters,
+        afw::table::BaseCatalog & samples,
+        ndarray::Array<Scalar,1,1> const & values
+    ) const {
+        int const n = parameters.getSize<0>();
+        for (int begin = 0; begin < n; begin += BATCH_SIZE) {
+            int end = std::min(begin + BATCH_SIZE, n);
+            _likelihood->computeNormalEquationsBatch(
+                parameters[ndarray::view(begin, end)()],
+                _hessians[ndarray::view(0, end - begin)],
+                _gradients[ndarray::view(0, end - begin)]
+            );
+            for (int k = begin; k < end; ++k) {
+                values[k] = _evaluate(parameters[k], _hessians[k - begin], _gradients[k - begin], samples[k]);
             }
         }
-        return getInterpreter()->getPrior()->marginalize(gradient, hessian, parameters);
     }
 
     MarginalSamplingObjective(
         PTR(SamplingInterpreter) interpreter,
         PTR(Likelihood) likelihood
-    ) : SamplingObjective(interpreter, likelihood)
+    ) : SamplingObjective(interpreter, likelihood),
+        _hessians(
+            ndarray::allocate(BATCH_SIZE, likelihood->getAmplitudeDim(), likelihood->getAmplitudeDim())
+        ),
+        _gradients(ndarray::allocate(BATCH_SIZE, likelihood->getAmplitudeDim()))
     {
         if (!getInterpreter()->getPrior()) {
             throw LSST_EXCEPT(
@@ -70,6 +82,36 @@ public:
         }
     }
 
+private:
+
+    // maximum number of points passed to Likelihood::computeNormalEquationsBatch at once
+    static int const BATCH_SIZE = 8;
+
+    // Compute the marginalized objective from the given normal equations, and save them in the
+    // sample's nested field.
+    Scalar _evaluate(
+        ndarray::Array<Scalar const,1,1> const & parameters,
+        ndarray::Array<Scalar const,2,2> const & hessianArray,
+        ndarray::Array<Scalar const,1,1> const & gradientArray,
+        afw::table::BaseRecord & sample
+    ) const {
+        Matrix hessian = hessianArray.asEigen();
+        Vector gradient = -gradientArray.asEigen();
+        ArrayKey nestedKey = static_cast<MarginalSamplingInterpreter &>(*getInterpreter()).getNestedKey();
+        ndarray::Array<Scalar,1,1> nested = sample[nestedKey];
+        int const n = _likelihood->getAmplitudeDim();
+        for (int i = 0, k = n; i < n; ++i) {
+            nested[i] = gradient[i];
+            for (int j = 0; j <= i; ++j, ++k) {
+                nested[k] = hessian(i, j);
+            }
+        }
+        return getInterpreter()->getPrior()->marginalize(gradient, hessian, parameters);
+    }
+
+    ndarray::Array<Scalar,3,3> _hessians;  // one per point in a batch; operator() uses the first
+    ndarray::Array<Scalar,2,2> _gradients;
+
 };
 
 } // anonymous
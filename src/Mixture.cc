@@ -262,6 +262,73 @@ void Mixture::evaluateDerivatives(
     }
 }
 
+void Mixture::evaluateLogDerivatives(
+    ndarray::Array<Scalar const,1,1> const & x,
+    ndarray::Array<Scalar,1,1> const & gradient,
+    ndarray::Array<Scalar,2,1> const & hessian
+) const {
+    LSST_THROW_IF_NE(
+        x.getSize<0>(), _dim,
+        pex::exceptions::LengthError,
+        "Size of x array (%d) does not dimension of mixture (%d)"
+    );
+    LSST_THROW_IF_NE(
+        gradient.getSize<0>(), _dim,
+        pex::exceptions::LengthError,
+        "Size of gradient array (%d) does not dimension of mixture (%d)"
+    );
+    LSST_THROW_IF_NE(
+        hessian.getSize<0>(), _dim,
+        pex::exceptions::LengthError,
+        "Number of rows of hessian array (%d) does not dimension of mixture (%d)"
+    );
+    LSST_THROW_IF_NE(
+        hessian.getSize<1>(), _dim,
+        pex::exceptions::LengthError,
+        "Number of columns of hessian array (%d) does not dimension of mixture (%d)"
+    );
+    gradient.deep() = 0.0;
+    hessian.deep() = 0.0;
+    Eigen::MatrixXd sigmaInv(_dim, _dim);
+    // We accumulate sum_k r_k d(ln p_k) and sum_k r_k (d^2 p_k)/p_k, where the unnormalized
+    // responsibilities r_k are relative to the largest component seen so far; when a larger one
+    // appears, we rescale everything accumulated up to that point.
+    Scalar maxLog = -std::numeric_limits<Scalar>::infinity();
+    Scalar sum = 0.0;
+    for (ComponentList::const_iterator i = _components.begin(); i != _components.end(); ++i) {
+        if (i->weight <= 0.0) continue;
+        _workspace = x.asEigen() - i->_mu;
+        i->_sigmaLLT.matrixL().solveInPlace(_workspace);
+        Scalar z = _workspace.squaredNorm();
+        i->_sigmaLLT.matrixL().adjoint().solveInPlace(_workspace);
+        sigmaInv.setIdentity();
+        i->_sigmaLLT.matrixL().solveInPlace(sigmaInv);
+        i->_sigmaLLT.matrixL().adjoint().solveInPlace(sigmaInv);
+        Scalar q = std::log(i->weight / i->_sqrtDet) + _evaluateLog(z);
+        if (q > maxLog) {
+            Scalar scale = std::exp(maxLog - q);
+            sum *= scale;
+            gradient.asEigen() *= scale;
+            hessian.asEigen() *= scale;
+            maxLog = q;
+        }
+        Scalar r = std::exp(q - maxLog);
+        sum += r;
+        if (_isGaussian) {
+            gradient.asEigen() -= r * _workspace;
+            hessian.asEigen() += r * (_workspace * _workspace.adjoint() - sigmaInv);
+        } else {
+            double v = (_dim + _df) / (_df + z);
+            double u = v*v*(1.0 + 2.0/(_dim + _df));
+            gradient.asEigen() -= r * v * _workspace;
+            hessian.asEigen() += r * (u * _workspace * _workspace.adjoint() - v * sigmaInv);
+        }
+    }
+    gradient.asEigen() /= sum;
+    hessian.asEigen() /= sum;
+    hessian.asEigen() -= gradient.asEigen() * gradient.asEigen().adjoint();
+}
+
 void Mixture::draw(afw::math::Random & rng, ndarray::Array<Scalar,2,1> const & x) const {
     ndarray::Array<Scalar,2,1>::Iterator ix = x.begin(), xEnd = x.end();
     std::vector<Scalar> cumulative;
@@ -411,6 +478,14 @@ Scalar Mixture::_evaluate(Scalar z) const {
     }
 }
 
+Scalar Mixture::_evaluateLog(Scalar z) const {
+    if (_isGaussian) {
+        return -0.5*z - std::log(_norm);
+    } else {
+        return -0.5*(_df + _dim)*std::log1p(z/_df) - std::log(_norm);
+    }
+}
+
 void Mixture::_stream(std::ostream & os) const {
     os << "Mixture(dim=" << _dim << ", [\n";
     for (const_iterator i = begin(); i != end(); ++i) {
@@ -47,7 +47,7 @@ Scalar MixturePrior::marginalize(
     ndarray::Array<Scalar const,1,1> const & parameters
 ) const {
     return TruncatedGaussian::fromSeriesParameters(0.0, gradient, hessian).getLogIntegral()
-        - std::log(_mixture->evaluate(parameters.asEigen()));
+        - _mixture->evaluateLog(parameters.asEigen());
 }
 
 Scalar MixturePrior::maximize(
@@ -86,6 +86,32 @@ void MixturePrior::evaluateDerivatives(
     crossHessian.deep() = 0.0;
 }
 
+Scalar MixturePrior::evaluateLog(
+    ndarray::Array<Scalar const,1,1> const & parameters,
+    ndarray::Array<Scalar const,1,1> const & amplitudes
+) const {
+    if ((amplitudes.asEigen<Eigen::ArrayXpr>() < 0.0).any()) {
+        return -std::numeric_limits<Scalar>::infinity();
+    } else {
+        return _mixture->evaluateLog(parameters.asEigen());
+    }
+}
+
+void MixturePrior::evaluateLogDerivatives(
+    ndarray::Array<Scalar const,1,1> const & nonlinear,
+    ndarray::Array<Scalar const,1,1> const & amplitudes,
+    ndarray::Array<Scalar,1,1> const & nonlinearGradient,
+    ndarray::Array<Scalar,1,1> const & amplitudeGradient,
+    ndarray::Array<Scalar,2,1> const & nonlinearHessian,
+    ndarray::Array<Scalar,2,1> const & amplitudeHessian,
+    ndarray::Array<Scalar,2,1> const & crossHessian
+) const {
+    _mixture->evaluateLogDerivatives(nonlinear, nonlinearGradient, nonlinearHessian);
+    amplitudeGradient.deep() = 0.0;
+    amplitudeHessian.deep() = 0.0;
+    crossHessian.deep() = 0.0;
+}
+
 void MixturePrior::drawAmplitudes(
     Vector const & gradient, Matrix const & hessian,
     ndarray::Array<Scalar const,1,1> const & nonlinear,
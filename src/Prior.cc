@@ -0,0 +1,71 @@
+// -*- lsst-c++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2008-2013 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+
+#include <cmath>
+#include <limits>
+
+#include "ndarray/eigen.h"
+
+#include "lsst/meas/multifit/Prior.h"
+
+namespace lsst { namespace meas { namespace multifit {
+
+Scalar Prior::evaluateLog(
+    ndarray::Array<Scalar const,1,1> const & nonlinear,
+    ndarray::Array<Scalar const,1,1> const & amplitudes
+) const {
+    Scalar p = evaluate(nonlinear, amplitudes);
+    if (p <= 0.0) {
+        return -std::numeric_limits<Scalar>::infinity();
+    }
+    return std::log(p);
+}
+
+void Prior::evaluateLogDerivatives(
+    ndarray::Array<Scalar const,1,1> const & nonlinear,
+    ndarray::Array<Scalar const,1,1> const & amplitudes,
+    ndarray::Array<Scalar,1,1> const & nonlinearGradient,
+    ndarray::Array<Scalar,1,1> const & amplitudeGradient,
+    ndarray::Array<Scalar,2,1> const & nonlinearHessian,
+    ndarray::Array<Scalar,2,1> const & amplitudeHessian,
+    ndarray::Array<Scalar,2,1> const & crossHessian
+) const {
+    // d(ln P) = dP/P; d^2(ln P) = d^2P/P - (dP/P)(dP/P)^T
+    Scalar p = evaluate(nonlinear, amplitudes);
+    evaluateDerivatives(
+        nonlinear, amplitudes,
+        nonlinearGradient, amplitudeGradient,
+        nonlinearHessian, amplitudeHessian, crossHessian
+    );
+    nonlinearGradient.asEigen() /= p;
+    amplitudeGradient.asEigen() /= p;
+    nonlinearHessian.asEigen() /= p;
+    amplitudeHessian.asEigen() /= p;
+    crossHessian.asEigen() /= p;
+    nonlinearHessian.asEigen() -= nonlinearGradient.asEigen() * nonlinearGradient.asEigen().adjoint();
+    amplitudeHessian.asEigen() -= amplitudeGradient.asEigen() * amplitudeGradient.asEigen().adjoint();
+    crossHessian.asEigen() -= nonlinearGradient.asEigen() * amplitudeGradient.asEigen().adjoint();
+}
+
+}}} // namespace lsst::meas::multifit
@@ -171,8 +171,17 @@ SamplingObjective::SamplingObjective(
     PTR(Likelihood) likelihood
 ) :
     _interpreter(interpreter),
-    _likelihood(likelihood),
-    _modelMatrix(ndarray::allocate(likelihood->getDataDim(), likelihood->getAmplitudeDim()))
+    _likelihood(likelihood)
 {}
 
+void SamplingObjective::evaluate(
+    ndarray::Array<Scalar const,2,1> const & parameters,
+    afw::table::BaseCatalog & samples,
+    ndarray::Array<Scalar,1,1> const & values
+) const {
+    for (int k = 0; k < parameters.getSize<0>(); ++k) {
+        values[k] = (*this)(parameters[k], samples[k]);
+    }
+}
+
 }}} // namespace lsst::meas::multifit
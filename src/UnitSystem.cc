@@ -21,6 +21,8 @@
  * see <http://www.lsstcorp.org/LegalNotices/>.
  */
 
+#include <cmath>
+
 #include "boost/format.hpp"
 #include "boost/make_shared.hpp"
 
@@ -51,4 +53,65 @@ LocalUnitTransform::LocalUnitTransform(
     sb(flux / geometric.getLinear().computeDeterminant())
 {}
 
+LocalUnitTransformCache::LocalUnitTransformCache(UnitSystem const & system, double gridSpacing) :
+    _system(system), _gridSpacing(gridSpacing)
+{}
+
+LocalUnitTransform LocalUnitTransformCache::toSystem(
+    afw::coord::Coord const & position,
+    UnitSystem const & destination
+) const {
+    if (destination.wcs->getCoordSystem() != _system.wcs->getCoordSystem()) {
+        return LocalUnitTransform(position, _system, destination);
+    }
+    afw::geom::Point2D sourcePixel = _system.wcs->skyToPixel(position);
+    afw::geom::Point2D destinationPixel = destination.wcs->skyToPixel(position);
+    afw::geom::LinearTransform linear
+        = destination.wcs->linearizeSkyToPixel(position, afw::geom::degrees).getLinear()
+        * _getLinearization(sourcePixel);
+    return LocalUnitTransform(
+        afw::geom::AffineTransform(linear, destinationPixel - linear(sourcePixel)),
+        destination.calib->getFluxMag0().first / _system.calib->getFluxMag0().first
+    );
+}
+
+LocalUnitTransform LocalUnitTransformCache::fromSystem(
+    afw::coord::Coord const & position,
+    UnitSystem const & source
+) const {
+    if (source.wcs->getCoordSystem() != _system.wcs->getCoordSystem()) {
+        return LocalUnitTransform(position, source, _system);
+    }
+    afw::geom::Point2D sourcePixel = source.wcs->skyToPixel(position);
+    afw::geom::Point2D destinationPixel = _system.wcs->skyToPixel(position);
+    afw::geom::LinearTransform linear
+        = _getLinearization(destinationPixel).invert()
+        * source.wcs->linearizePixelToSky(position, afw::geom::degrees).getLinear();
+    return LocalUnitTransform(
+        afw::geom::AffineTransform(linear, destinationPixel - linear(sourcePixel)),
+        _system.calib->getFluxMag0().first / source.calib->getFluxMag0().first
+    );
+}
+
+afw::geom::LinearTransform LocalUnitTransformCache::_getLinearization(
+    afw::geom::Point2D const & pixel
+) const {
+    if (_gridSpacing <= 0.0) {
+        return _system.wcs->linearizePixelToSky(pixel, afw::geom::degrees).getLinear();
+    }
+    std::pair<int,int> cell(
+        static_cast<int>(std::floor(pixel.getX() / _gridSpacing)),
+        static_cast<int>(std::floor(pixel.getY() / _gridSpacing))
+    );
+    std::map<std::pair<int,int>,afw::geom::LinearTransform>::const_iterator i = _linearizations.find(cell);
+    if (i != _linearizations.end()) {
+        return i->second;
+    }
+    afw::geom::Point2D center((cell.first + 0.5) * _gridSpacing, (cell.second + 0.5) * _gridSpacing);
+    afw::geom::LinearTransform result
+        = _system.wcs->linearizePixelToSky(center, afw::geom::degrees).getLinear();
+    _linearizations.insert(std::make_pair(cell, result));
+    return result;
+}
+
 }}} // namespace lsst::meas::multifit
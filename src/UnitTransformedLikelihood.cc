@@ -21,17 +21,22 @@
  * see <http://www.lsstcorp.org/LegalNotices/>.
  */
 #include <algorithm>
+#include <cmath>
 #include <limits>
-#include <numeric>
+#include <map>
 
 #include "boost/format.hpp"
 #include "boost/make_shared.hpp"
+#include "boost/bind.hpp"
 #include "ndarray/eigen.h"
 
+#include "lsst/utils/ieee.h"
 #include "lsst/afw/image/Calib.h"
 #include "lsst/afw/detection/FootprintArray.cc"  // yes .cc; see the file for an explanation
 #include "lsst/shapelet/MatrixBuilder.h"
+#include "lsst/shapelet/MultiShapeletBasis.h"
 #include "lsst/meas/multifit/UnitTransformedLikelihood.h"
+#include "lsst/meas/multifit/parallel.h"
 
 namespace lsst { namespace meas { namespace multifit {
 
@@ -41,32 +46,55 @@ typedef std::vector< shapelet::MatrixBuilder<Pixel> > BuilderVector;
 typedef std::vector< shapelet::MatrixBuilderFactory<Pixel> > FactoryVector;
 
 /*
- * Function intended for use with std algorithms to compute the cumulative sum
- * of the number of pixels in a sequence of EpochFootprints
+ * Return the subset of a Footprint that should be included in the fit: if badMaskPlanes is empty, this
+ * is the full Footprint; if not, we drop pixels with any of those mask planes set, as well as pixels
+ * with non-finite image values or non-positive (or non-finite) variance, as these would otherwise
+ * get zero or non-finite weights.
  */
-int componentPixelSum(int partialNumPixels, CONST_PTR(EpochFootprint) const &epochImagePtr) {
-    return partialNumPixels + epochImagePtr->footprint.getArea();
+afw::detection::Footprint selectPixels(
+    afw::detection::Footprint const & footprint,
+    afw::image::MaskedImage<Pixel> const & image,
+    std::vector<std::string> const & badMaskPlanes
+) {
+    if (badMaskPlanes.empty()) return footprint;
+    afw::image::MaskPixel const badPixelMask = afw::image::Mask<>::getPlaneBitMask(badMaskPlanes);
+    ndarray::Array<Pixel const,2,1> imageArray = image.getImage()->getArray();
+    ndarray::Array<afw::image::MaskPixel const,2,1> maskArray = image.getMask()->getArray();
+    ndarray::Array<afw::image::VariancePixel const,2,1> varianceArray = image.getVariance()->getArray();
+    int const x0 = image.getX0();
+    int const y0 = image.getY0();
+    afw::detection::Footprint result;
+    for (
+        afw::detection::Footprint::SpanList::const_iterator i = footprint.getSpans().begin();
+        i != footprint.getSpans().end();
+        ++i
+    ) {
+        int const y = (**i).getY();
+        int begin = (**i).getX0(); // start of the current run of good pixels
+        for (int x = (**i).getX0(); x <= (**i).getX1(); ++x) {
+            Pixel value = imageArray[y - y0][x - x0];
+            afw::image::VariancePixel variance = varianceArray[y - y0][x - x0];
+            bool isGood = !(maskArray[y - y0][x - x0] & badPixelMask)
+                && utils::isfinite(value) && utils::isfinite(variance) && variance > 0.0;
+            if (!isGood) {
+                if (x > begin) result.addSpan(y, begin, x - 1);
+                begin = x + 1;
+            }
+        }
+        if ((**i).getX1() >= begin) result.addSpan(y, begin, (**i).getX1());
+    }
+    result.normalize();
+    return result;
 }
 
 /*
- * Return a vector of MatrixBuilders, with one for each MultiShapeletBasis in the input vector,
- * using the pixel region defined by the given Footprint and the given shapelet PSF approximation.
- *
- * basisVector - vector of MultiShapeletBasis objects; will produce one MatrixBuilder for each.
- * psf - MultiShapeletFunction representation of the PSF
- * footprint - Footprint that defines the region of pixels that will be used in the fit.
+ * Fill x and y with the positions of the pixels in a Footprint, in the same order as flattenArray.
  */
-BuilderVector makeMatrixBuilders(
-    Model::BasisVector const & basisVector,
-    shapelet::MultiShapeletFunction const & psf,
-    afw::detection::Footprint const & footprint
+void flattenFootprintPositions(
+    afw::detection::Footprint const & footprint,
+    ndarray::Array<Pixel,1,1> const & x,
+    ndarray::Array<Pixel,1,1> const & y
 ) {
-    BuilderVector builders;
-    FactoryVector factories;
-    builders.reserve(basisVector.size());
-    factories.reserve(basisVector.size());
-    ndarray::Array<Pixel,1,1> x = ndarray::allocate(footprint.getArea());
-    ndarray::Array<Pixel,1,1> y = ndarray::allocate(footprint.getArea());
     int n = 0;
     for (
         afw::detection::Footprint::SpanList::const_iterator i = footprint.getSpans().begin();
@@ -78,10 +106,82 @@ BuilderVector makeMatrixBuilders(
             y[n] = j->getY();
         }
     }
+}
+
+/*
+ * A MultiShapeletBasis that is evaluated with its own MatrixBuilder, along with the ellipse and the
+ * block of model matrix columns it corresponds to.  Without truncation, there is one of these for
+ * each basis in the Model; with truncation, each multi-component basis is split into one BasisTerm
+ * per component, so components can be skipped individually.
+ */
+struct BasisTerm {
+    int ellipse;          // index of the Model ellipse this term is evaluated with
+    int amplitudeOffset;  // first model matrix column the term contributes to
+    int order;            // shapelet order of the (single) component; ignored without truncation
+    double radius;        // radius of the component relative to the ellipse; ignored without truncation
+    PTR(shapelet::MultiShapeletBasis) basis;
+};
+
+typedef std::vector<BasisTerm> TermVector;
+
+/*
+ * Return the BasisTerms for the given Model bases, splitting them into components if doSplit.
+ */
+TermVector makeBasisTerms(Model::BasisVector const & basisVector, bool doSplit) {
+    TermVector terms;
+    int amplitudeOffset = 0;
+    for (std::size_t j = 0; j < basisVector.size(); ++j) {
+        shapelet::MultiShapeletBasis const & basis = *basisVector[j];
+        if (!doSplit) {
+            BasisTerm term = { int(j), amplitudeOffset, 0, 1.0, basisVector[j] };
+            terms.push_back(term);
+        } else {
+            for (shapelet::MultiShapeletBasis::Iterator c = basis.begin(); c != basis.end(); ++c) {
+                BasisTerm term = {
+                    int(j), amplitudeOffset, c->getOrder(), c->getRadius(),
+                    boost::make_shared<shapelet::MultiShapeletBasis>(basis.getSize())
+                };
+                term.basis->addComponent(c->getRadius(), c->getOrder(), c->getMatrix());
+                terms.push_back(term);
+            }
+        }
+        amplitudeOffset += basis.getSize();
+    }
+    return terms;
+}
+
+/*
+ * Return a vector of MatrixBuilderFactories, with one for each BasisTerm in the input vector,
+ * using the given pixel positions and the given shapelet PSF approximation.
+ *
+ * terms - vector of BasisTerms; will produce one factory for each.
+ * psf - MultiShapeletFunction representation of the PSF
+ * x, y - positions of the pixels that will be used in the fit.
+ */
+FactoryVector makeMatrixBuilderFactories(
+    TermVector const & terms,
+    shapelet::MultiShapeletFunction const & psf,
+    ndarray::Array<Pixel const,1,1> const & x,
+    ndarray::Array<Pixel const,1,1> const & y
+) {
+    FactoryVector factories;
+    factories.reserve(terms.size());
+    for (TermVector::const_iterator k = terms.begin(); k != terms.end(); ++k) {
+        factories.push_back(shapelet::MatrixBuilderFactory<Pixel>(x, y, *k->basis, psf));
+    }
+    return factories;
+}
+
+/*
+ * Return a vector of MatrixBuilders, with one for each of the given factories, all sharing a single
+ * new workspace.
+ */
+BuilderVector makeMatrixBuilders(FactoryVector const & factories) {
+    BuilderVector builders;
+    builders.reserve(factories.size());
     int workspaceSize = 0;
-    for (Model::BasisVector::const_iterator k = basisVector.begin(); k != basisVector.end(); ++k) {
-        factories.push_back(shapelet::MatrixBuilderFactory<Pixel>(x, y, **k, psf));
-        workspaceSize = std::max(workspaceSize, factories.back().computeWorkspace());
+    for (FactoryVector::const_iterator i = factories.begin(); i != factories.end(); ++i) {
+        workspaceSize = std::max(workspaceSize, i->computeWorkspace());
     }
     shapelet::MatrixBuilderWorkspace<Pixel> workspace(workspaceSize);
     for (FactoryVector::const_iterator i = factories.begin(); i != factories.end(); ++i) {
@@ -92,72 +192,671 @@ BuilderVector makeMatrixBuilders(
 }
 
 /*
- *  Flatten image and variance arrays from a MaskedImage using a footprint, and transform
- *  the variance into weights.
+ * The flattened pixels of one epoch: positions, image values, and variances, along with the number of
+ * original pixels each element represents (one, except for superpixels).
+ */
+struct EpochPixels {
+    ndarray::Array<Pixel,1,1> x;
+    ndarray::Array<Pixel,1,1> y;
+    ndarray::Array<Pixel,1,1> data;
+    ndarray::Array<Pixel,1,1> variance;
+    ndarray::Array<Pixel,1,1> count;
+    Scalar halfWidth; // half the width of the largest (super)pixel
+    int nSuperpixels; // number of superpixels, which always follow all native-resolution pixels
+
+    explicit EpochPixels(int n) :
+        x(ndarray::allocate(n)), y(ndarray::allocate(n)),
+        data(ndarray::allocate(n)), variance(ndarray::allocate(n)), count(ndarray::allocate(n)),
+        halfWidth(0.5), nSuperpixels(0)
+    {}
+
+    int getSize() const { return x.getSize<0>(); }
+
+    // Return a view of elements [begin, end), with the given half-width.
+    EpochPixels slice(int begin, int end, Scalar halfWidth_) const {
+        EpochPixels result(0);
+        result.x = x[ndarray::view(begin, end)];
+        result.y = y[ndarray::view(begin, end)];
+        result.data = data[ndarray::view(begin, end)];
+        result.variance = variance[ndarray::view(begin, end)];
+        result.count = count[ndarray::view(begin, end)];
+        result.halfWidth = halfWidth_;
+        return result;
+    }
+};
+
+/*
+ * Flatten the positions, image values and variances of the pixels in a footprint.
+ */
+EpochPixels flattenPixels(
+    afw::image::MaskedImage<Pixel> const & image,
+    afw::detection::Footprint const & footprint
+) {
+    EpochPixels result(footprint.getArea());
+    flattenFootprintPositions(footprint, result.x, result.y);
+    afw::detection::flattenArray(footprint, image.getImage()->getArray(), result.data, image.getXY0());
+    afw::detection::flattenArray(footprint, image.getVariance()->getArray(), result.variance, image.getXY0());
+    result.count.deep() = 1.0;
+    return result;
+}
+
+/*
+ * Combine pixels into superpixels: the footprint is divided into size x size blocks on a grid aligned
+ * with the pixel origin, and each block with at least minPixels pixels present and whose combined S/N
+ * is below maxSignalToNoise (which may be infinite) is replaced by a single superpixel at the mean
+ * position of its pixels.  A superpixel's value is the mean of its pixels, and its variance is the
+ * variance of that mean.  Its model should be evaluated at its center with a PSF broadened by
+ * broadenPsf, which approximates the mean of the model over a fully-populated block.  Other pixels
+ * are kept at native resolution, ahead of all superpixels.
+ */
+EpochPixels binPixels(EpochPixels const & input, int size, Scalar maxSignalToNoise, int minPixels) {
+    typedef std::map< std::pair<int,int>, std::vector<int> > BlockMap;
+    BlockMap blocks;
+    for (int i = 0; i < input.getSize(); ++i) {
+        std::pair<int,int> key(
+            static_cast<int>(std::floor(input.y[i] / size)), // sort blocks by row first
+            static_cast<int>(std::floor(input.x[i] / size))
+        );
+        blocks[key].push_back(i);
+    }
+    std::vector<bool> isBinned(input.getSize(), false);
+    std::vector<BlockMap::const_iterator> binnedBlocks;
+    int nOutput = input.getSize();
+    for (BlockMap::const_iterator b = blocks.begin(); b != blocks.end(); ++b) {
+        if (static_cast<int>(b->second.size()) < minPixels) continue;
+        Scalar sum = 0.0;
+        Scalar variance = 0.0;
+        for (std::vector<int>::const_iterator i = b->second.begin(); i != b->second.end(); ++i) {
+            sum += input.data[*i];
+            variance += input.variance[*i];
+        }
+        if (std::abs(sum) >= maxSignalToNoise * std::sqrt(variance)) continue;
+        for (std::vector<int>::const_iterator i = b->second.begin(); i != b->second.end(); ++i) {
+            isBinned[*i] = true;
+        }
+        binnedBlocks.push_back(b);
+        nOutput -= b->second.size() - 1;
+    }
+    EpochPixels output(nOutput);
+    int n = 0;
+    for (int i = 0; i < input.getSize(); ++i) {
+        if (isBinned[i]) continue;
+        output.x[n] = input.x[i];
+        output.y[n] = input.y[i];
+        output.data[n] = input.data[i];
+        output.variance[n] = input.variance[i];
+        output.count[n] = input.count[i];
+        ++n;
+    }
+    for (std::size_t k = 0; k < binnedBlocks.size(); ++k, ++n) {
+        std::vector<int> const & members = binnedBlocks[k]->second;
+        Scalar x = 0.0, y = 0.0, data = 0.0, variance = 0.0;
+        for (std::vector<int>::const_iterator i = members.begin(); i != members.end(); ++i) {
+            x += input.x[*i];
+            y += input.y[*i];
+            data += input.data[*i];
+            variance += input.variance[*i];
+        }
+        Scalar m = members.size();
+        output.x[n] = x / m;
+        output.y[n] = y / m;
+        output.data[n] = data / m;
+        output.variance[n] = variance / (m * m);
+        output.count[n] = m;
+    }
+    // Superpixels from partially-populated blocks aren't centered on their blocks, so we need a
+    // half-width large enough to cover a block from any point within it.
+    output.halfWidth = binnedBlocks.empty() ? input.halfWidth : size - 0.5;
+    output.nSuperpixels = binnedBlocks.size();
+    return output;
+}
+
+/*
+ * Convolve a PSF with a circular Gaussian whose variance, (n^2 - 1)/12, matches that of the positions
+ * of the pixels in an n x n block about their mean.  Evaluating the broadened model at the center of
+ * the block then approximates the mean of the original model over the pixels in the block.
+ */
+shapelet::MultiShapeletFunction broadenPsf(shapelet::MultiShapeletFunction const & psf, int binFactor) {
+    Scalar sigma = std::sqrt((binFactor * binFactor - 1) / 12.0);
+    shapelet::ShapeletFunction component(
+        0, shapelet::HERMITE, afw::geom::ellipses::Ellipse(afw::geom::ellipses::Axes(sigma, sigma, 0.0))
+    );
+    component.getCoefficients()[0] = 1.0;
+    component.normalize();
+    shapelet::MultiShapeletFunction kernel;
+    kernel.getComponents().push_back(component);
+    return psf.convolve(kernel);
+}
+
+/*
+ *  Transform the variances of flattened pixels into weights, and apply them to the data.
  *
- *  image - MaskedImage whose image and variance pixels should be used in the fit
- *  footprint - Footprint that defines the pixels to be included in the fit
- *  data - array to be filled with flattened values from the MaskedImage's image plane
- *  weights - array to be filled with flattened values computed from the MaskedImage's variance plane
+ *  pixels - flattened pixels from flattenPixels or binPixels
+ *  data - array to be filled with the weighted image values
+ *  weights - array to be filled with weights computed from the variances
  *  usePixelWeights - if true, weights will be per-pixel inverse sqrt(variance); if false, a constant
- *                    average value will be used
+ *                    average value will be used (scaled by the square root of the number of pixels
+ *                    in each superpixel)
  */
 void setupArrays(
-    afw::image::MaskedImage<Pixel> const & image,
-    afw::detection::Footprint const & footprint,
+    EpochPixels const & pixels,
     ndarray::Array<Pixel,1,1> const & data,
     ndarray::Array<Pixel,1,1> const & weights,
     bool usePixelWeights
 ) {
-    afw::detection::flattenArray(footprint, image.getImage()->getArray(), data, image.getXY0());
-    afw::detection::flattenArray(footprint, image.getVariance()->getArray(), weights, image.getXY0());
     // Convert from variance to weights (1/sigma); this is actually the usual inverse-variance
     // weighting, because we implicitly square it later.
-    weights.asEigen<Eigen::ArrayXpr>() = weights.asEigen<Eigen::ArrayXpr>().sqrt().inverse();
+    weights.asEigen<Eigen::ArrayXpr>() = pixels.variance.asEigen<Eigen::ArrayXpr>().sqrt().inverse();
     if (!usePixelWeights) {
         // We want a single number for the weights, so we use the geometric mean, as that
-        // preserves the determinant of the (diagonal) pixel covariance matrix.
-        weights.asEigen<Eigen::ArrayXpr>().setConstant(
-            std::exp(static_cast<double>(weights.asEigen<Eigen::ArrayXpr>().log().mean()))
+        // preserves the determinant of the (diagonal) pixel covariance matrix.  Superpixels
+        // are averages of count pixels, so we take the mean of the equivalent single-pixel weights.
+        Eigen::ArrayXf sqrtCount = pixels.count.asEigen<Eigen::ArrayXpr>().sqrt();
+        weights.asEigen<Eigen::ArrayXpr>() = sqrtCount * static_cast<Pixel>(
+            std::exp(static_cast<double>((weights.asEigen<Eigen::ArrayXpr>() / sqrtCount).log().mean()))
             // static_cast == workaround for ambiguous resolution on clang
         );
     }
-    data.asEigen<Eigen::ArrayXpr>() *= weights.asEigen<Eigen::ArrayXpr>();
+    data.asEigen<Eigen::ArrayXpr>()
+        = pixels.data.asEigen<Eigen::ArrayXpr>() * weights.asEigen<Eigen::ArrayXpr>();
 }
 
+// Number of pixels in each tile of the model matrix evaluated by computeNormalEquations; small enough
+// that a tile (in both single and double precision) stays in cache for typical amplitude counts.
+int const NORMAL_EQUATIONS_TILE_ROWS = 256;
+
+// Maximum number of pixels in each chunk when truncation is enabled, regardless of maxChunkPixels:
+// a component can only be skipped on chunks that lie entirely outside its extent, so chunks must be
+// small compared to the footprint.  This is no larger than NORMAL_EQUATIONS_TILE_ROWS, so the chunks
+// can also be used as normal equation tiles.
+int const TRUNCATION_CHUNK_ROWS = 256;
+
 } // anonymous
 
 EpochFootprint::EpochFootprint(
     afw::detection::Footprint const &footprint_,
     afw::image::Exposure<Pixel> const &exposure_,
-    shapelet::MultiShapeletFunction const & psf_
+    shapelet::MultiShapeletFunction const & psf_,
+    PTR(LocalUnitTransformCache) transformCache_
 ) :
     footprint(footprint_),
     exposure(afw::image::Exposure<Pixel>(exposure_, false)),
-    psf(psf_)
+    psf(psf_),
+    transformCache(transformCache_)
 {}
 
 class UnitTransformedLikelihood::Impl {
 public:
 
+    // A block of rows of the model matrix: either a full epoch, or a chunk of one.  Each has its
+    // own builder workspace, so different Epochs can be evaluated concurrently.
     class Epoch {
     public:
 
-        Epoch(int nPix_, LocalUnitTransform const & transform_, BuilderVector const & builders_) :
-            nPix(nPix_), transform(transform_), builders(builders_) {}
+        Epoch(
+            int dataOffset_, int nPix_, afw::geom::Box2D const & bbox_,
+            LocalUnitTransform const & transform_,
+            shapelet::MultiShapeletFunction const & psf,
+            FactoryVector const & factories_
+        ) :
+            dataOffset(dataOffset_), nPix(nPix_), bbox(bbox_), transform(transform_),
+            factories(factories_), builders(makeMatrixBuilders(factories))
+        {
+            psfEllipses.reserve(psf.getComponents().size());
+            for (std::size_t i = 0; i < psf.getComponents().size(); ++i) {
+                psfEllipses.push_back(psf.getComponents()[i].getEllipse());
+            }
+        }
+
+        // Builders share workspace, so copies get new builders from the same factories.
+        Epoch(Epoch const & other) :
+            dataOffset(other.dataOffset), nPix(other.nPix), bbox(other.bbox), transform(other.transform),
+            psfEllipses(other.psfEllipses), factories(other.factories),
+            builders(makeMatrixBuilders(factories))
+        {}
+
+        Epoch & operator=(Epoch const & other) {
+            if (&other != this) {
+                dataOffset = other.dataOffset;
+                nPix = other.nPix;
+                bbox = other.bbox;
+                transform = other.transform;
+                psfEllipses = other.psfEllipses;
+                factories = other.factories;
+                builders = makeMatrixBuilders(factories);
+            }
+            return *this;
+        }
 
+        /*
+         * Return true if the given term, evaluated with the given (already transformed) ellipse, is
+         * negligible on all pixels of this Epoch.  We bound each PSF-convolved Gaussian by the box
+         * around its k-sigma ellipse, with k^2 increased by 2*order to account for the extra reach of
+         * higher-order shapelets.
+         */
+        bool isNegligible(
+            BasisTerm const & term,
+            afw::geom::ellipses::Ellipse const & ellipse,
+            Scalar truncationRadius
+        ) const {
+            afw::geom::ellipses::Quadrupole moments(ellipse.getCore());
+            Scalar k2 = truncationRadius * truncationRadius + 2.0 * term.order;
+            Scalar r2 = term.radius * term.radius;
+            for (
+                std::vector<afw::geom::ellipses::Ellipse>::const_iterator i = psfEllipses.begin();
+                i != psfEllipses.end();
+                ++i
+            ) {
+                afw::geom::ellipses::Quadrupole psfMoments(i->getCore());
+                afw::geom::Extent2D halfWidth(
+                    std::sqrt(k2 * (r2 * moments.getIxx() + psfMoments.getIxx())),
+                    std::sqrt(k2 * (r2 * moments.getIyy() + psfMoments.getIyy()))
+                );
+                afw::geom::Point2D center = ellipse.getCenter() + afw::geom::Extent2D(i->getCenter());
+                if (bbox.overlaps(afw::geom::Box2D(center - halfWidth, center + halfWidth))) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        int dataOffset;
         int nPix;
+        afw::geom::Box2D bbox; // bounding box of the pixels
+        LocalUnitTransform transform;
+        std::vector<afw::geom::ellipses::Ellipse> psfEllipses;
+        FactoryVector factories; // one for each BasisTerm
+        BuilderVector builders;  // one for each BasisTerm
+    };
+
+    // The transform, PSF, and pixel positions that were used to create a set of chunks; these are all
+    // we need to split the same pixels into normal equation tiles.  The positions are shared with the
+    // chunks' MatrixBuilderFactories, so keeping them costs no extra memory.
+    struct TileSource {
+
+        TileSource(
+            int dataOffset_,
+            LocalUnitTransform const & transform_,
+            shapelet::MultiShapeletFunction const & psf_,
+            EpochPixels const & pixels
+        ) : dataOffset(dataOffset_), transform(transform_), psf(psf_),
+            x(pixels.x), y(pixels.y), halfWidth(pixels.halfWidth)
+        {}
+
+        int dataOffset;
         LocalUnitTransform transform;
-        BuilderVector builders;
+        shapelet::MultiShapeletFunction psf;
+        ndarray::Array<Pixel const,1,1> x;
+        ndarray::Array<Pixel const,1,1> y;
+        Scalar halfWidth;
     };
 
-    Impl() : scratch(afw::geom::ellipses::Quadrupole(), afw::geom::Point2D()) {}
+    // The transform, PSF, and (unbinned) pixels of one exposure, kept after setup only if
+    // ctrl.keepUnbinnedPixels is set, so we can rebin them later.
+    struct Input {
+
+        Input(
+            LocalUnitTransform const & transform_,
+            shapelet::MultiShapeletFunction const & psf_,
+            EpochPixels const & pixels_
+        ) : transform(transform_), psf(psf_), pixels(pixels_) {}
+
+        LocalUnitTransform transform;
+        shapelet::MultiShapeletFunction psf;
+        EpochPixels pixels;
+    };
+
+    Impl(
+        UnitTransformedLikelihoodControl const & ctrl_,
+        TermVector const & terms_,
+        Scalar truncationRadius_
+    ) :
+        ctrl(ctrl_), nThreads(std::max(ctrl_.nThreads, 1)), pool(nThreads),
+        truncationRadius(truncationRadius_), terms(terms_)
+    {
+        scratch.reserve(nThreads);
+        for (int i = 0; i < nThreads; ++i) {
+            scratch.push_back(
+                afw::geom::ellipses::Ellipse(afw::geom::ellipses::Quadrupole(), afw::geom::Point2D())
+            );
+        }
+    }
+
+    // Bin the pixels of all inputs (into binFactor x binFactor blocks if binFactor > 1, or into
+    // superpixels as configured otherwise), add their Epochs, and fill the data and weights arrays.
+    void setup(ndarray::Array<Pixel,1,1> & data, ndarray::Array<Pixel,1,1> & weights, int binFactor) {
+        std::vector<EpochPixels> pixels;
+        std::vector<shapelet::MultiShapeletFunction> psfs;
+        pixels.reserve(inputs.size());
+        psfs.reserve(inputs.size());
+        int totPixels = 0;
+        for (std::vector<Input>::const_iterator i = inputs.begin(); i != inputs.end(); ++i) {
+            if (binFactor > 1) {
+                pixels.push_back(binPixels(i->pixels, binFactor, std::numeric_limits<Scalar>::infinity(), 1));
+                psfs.push_back(broadenPsf(i->psf, binFactor));
+            } else if (ctrl.superpixelSize >= 2) {
+                pixels.push_back(
+                    binPixels(
+                        i->pixels, ctrl.superpixelSize, ctrl.superpixelMaxSignalToNoise,
+                        ctrl.superpixelSize * ctrl.superpixelSize
+                    )
+                );
+                psfs.push_back(i->psf);
+            } else {
+                pixels.push_back(i->pixels);
+                psfs.push_back(i->psf);
+            }
+            totPixels += pixels.back().getSize();
+        }
+        data = ndarray::allocate(totPixels);
+        weights = ndarray::allocate(totPixels);
+        int dataOffset = 0;
+        for (std::size_t n = 0; n < inputs.size(); ++n) {
+            int dataEnd = dataOffset + pixels[n].getSize();
+            if (binFactor <= 1 && pixels[n].nSuperpixels > 0) {
+                // Native pixels use the original PSF; superpixels need one broadened to match the
+                // blocks they average, just as every pixel of a downsampled image does.
+                int nNative = pixels[n].getSize() - pixels[n].nSuperpixels;
+                addEpoch(
+                    dataOffset, inputs[n].transform, psfs[n],
+                    pixels[n].slice(0, nNative, inputs[n].pixels.halfWidth), ctrl.maxChunkPixels
+                );
+                addEpoch(
+                    dataOffset + nNative, inputs[n].transform, broadenPsf(psfs[n], ctrl.superpixelSize),
+                    pixels[n].slice(nNative, pixels[n].getSize(), pixels[n].halfWidth), ctrl.maxChunkPixels
+                );
+            } else {
+                addEpoch(dataOffset, inputs[n].transform, psfs[n], pixels[n], ctrl.maxChunkPixels);
+            }
+            setupArrays(
+                pixels[n],
+                data[ndarray::view(dataOffset, dataEnd)],
+                weights[ndarray::view(dataOffset, dataEnd)],
+                ctrl.usePixelWeights
+            );
+            dataOffset = dataEnd;
+        }
+        if (!ctrl.keepUnbinnedPixels) {
+            std::vector<Input>().swap(inputs); // release the unbinned pixels
+        }
+    }
+
+    // Add the Epoch(s) for the given pixels, which start at row dataOffset, to the list of (threading)
+    // chunks, and remember what we need to split them into normal equation tiles later.
+    void addEpoch(
+        int dataOffset,
+        LocalUnitTransform const & transform,
+        shapelet::MultiShapeletFunction const & psf,
+        EpochPixels const & pixels,
+        int maxChunkPixels
+    ) {
+        int nPix = pixels.getSize();
+        if (truncationRadius > 0.0 && (maxChunkPixels <= 0 || maxChunkPixels > TRUNCATION_CHUNK_ROWS)) {
+            maxChunkPixels = TRUNCATION_CHUNK_ROWS;
+        }
+        int nChunks = (maxChunkPixels > 0) ? (nPix + maxChunkPixels - 1) / maxChunkPixels : 1;
+        int chunkSize = (nPix + nChunks - 1) / std::max(nChunks, 1);
+        for (int begin = 0; begin < nPix; begin += chunkSize) {
+            int end = std::min(begin + chunkSize, nPix);
+            epochs.push_back(
+                makeEpoch(dataOffset, transform, psf, pixels.x, pixels.y, pixels.halfWidth, begin, end)
+            );
+        }
+        tileSources.push_back(TileSource(dataOffset, transform, psf, pixels));
+    }
+
+    // Make an Epoch for pixels [begin, end) of the given pixel positions, which start at row dataOffset.
+    Epoch makeEpoch(
+        int dataOffset,
+        LocalUnitTransform const & transform,
+        shapelet::MultiShapeletFunction const & psf,
+        ndarray::Array<Pixel const,1,1> const & x,
+        ndarray::Array<Pixel const,1,1> const & y,
+        Scalar h, // half the width of the largest pixel
+        int begin, int end
+    ) const {
+        // Include the full extent of each pixel, so single-row chunks don't have empty boxes.
+        afw::geom::Box2D bbox;
+        for (int i = begin; i < end; ++i) {
+            bbox.include(afw::geom::Point2D(x[i] - h, y[i] - h));
+            bbox.include(afw::geom::Point2D(x[i] + h, y[i] + h));
+        }
+        return Epoch(
+            dataOffset + begin, end - begin, bbox, transform, psf,
+            makeMatrixBuilderFactories(terms, psf, x[ndarray::view(begin, end)], y[ndarray::view(begin, end)])
+        );
+    }
+
+    // Fill the rows of the model matrix that correspond to epochs[n]; may be called concurrently
+    // for different epochs as long as each thread uses a different worker index.  The ellipses
+    // must already have been set.
+    void computeEpoch(
+        int n, int worker,
+        ndarray::Array<Pixel,2,-1> const & modelMatrix,
+        ndarray::Array<Pixel const,1,1> const & weights
+    ) const {
+        Epoch const & epoch = epochs[n];
+        fillEpoch(
+            epoch, worker, ellipses,
+            modelMatrix[ndarray::view(epoch.dataOffset, epoch.dataOffset + epoch.nPix)()],
+            weights
+        );
+    }
+
+    // Fill the rows that correspond to epochs[n] in each of a batch of (transposed) model matrices,
+    // one for each element of batchEllipses.  Evaluating all points for one epoch before moving on
+    // keeps its pixel positions and builder workspace in cache, and since different threads always
+    // work on different epochs, they never share a MatrixBuilder.
+    void computeEpochBatch(
+        int n, int worker,
+        ndarray::Array<Pixel,3,3> const & modelMatrices,
+        ndarray::Array<Pixel const,1,1> const & weights
+    ) const {
+        Epoch const & epoch = epochs[n];
+        // The flux scaling and pixel weights are the same for every point, so we combine them once
+        // and apply them to each point's rows in a single pass.
+        Eigen::Array<Pixel,Eigen::Dynamic,1> scale(epoch.nPix);
+        scale.setConstant(epoch.transform.flux);
+        if (!weights.isEmpty()) {
+            scale *= weights[ndarray::view(epoch.dataOffset, epoch.dataOffset + epoch.nPix)]
+                .asEigen<Eigen::ArrayXpr>();
+        }
+        for (int k = 0; k < modelMatrices.getSize<0>(); ++k) {
+            ndarray::Array<Pixel,2,-1> modelMatrix = modelMatrices[k].transpose();
+            ndarray::Array<Pixel,2,-1> rows
+                = modelMatrix[ndarray::view(epoch.dataOffset, epoch.dataOffset + epoch.nPix)()];
+            fillEpochUnscaled(epoch, worker, batchEllipses[k], rows);
+            rows.asEigen<Eigen::ArrayXpr>().colwise() *= scale;
+        }
+    }
+
+    // Return the Epochs that computeNormalEquations loops over.  If every chunk is already small enough,
+    // these are just the chunks; otherwise they're a separate set of tiles of at most
+    // NORMAL_EQUATIONS_TILE_ROWS pixels, built on first use so likelihoods that never compute normal
+    // equations (e.g. in optimizer fits) don't pay for a second set of MatrixBuilders.
+    std::vector<Epoch> const & getNormalEquationTiles() const {
+        int maxPix = 0;
+        for (std::vector<Epoch>::const_iterator i = epochs.begin(); i != epochs.end(); ++i) {
+            maxPix = std::max(maxPix, i->nPix);
+        }
+        if (maxPix <= NORMAL_EQUATIONS_TILE_ROWS) {
+            return epochs;
+        }
+        if (normalEquationTiles.empty()) {
+            for (
+                std::vector<TileSource>::const_iterator i = tileSources.begin();
+                i != tileSources.end();
+                ++i
+            ) {
+                int nPix = i->x.getSize<0>();
+                for (int begin = 0; begin < nPix; begin += NORMAL_EQUATIONS_TILE_ROWS) {
+                    int end = std::min(begin + NORMAL_EQUATIONS_TILE_ROWS, nPix);
+                    normalEquationTiles.push_back(
+                        makeEpoch(i->dataOffset, i->transform, i->psf, i->x, i->y, i->halfWidth, begin, end)
+                    );
+                }
+            }
+        }
+        return normalEquationTiles;
+    }
+
+    // Add the contribution of tileEpochs[n] (as returned by getNormalEquationTiles) to the normal
+    // equations accumulated by the given worker; allocateNormalEquations must have been called first.
+    void accumulateNormalEquations(
+        int n, int worker,
+        std::vector<Epoch> const & tileEpochs,
+        ndarray::Array<Pixel const,1,1> const & weights,
+        ndarray::Array<Pixel const,1,1> const & data
+    ) const {
+        accumulateTile(tileEpochs[n], worker, ellipses, worker, weights, data);
+    }
+
+    // Add the contribution of tileEpochs[n] at each of the first nPoints elements of batchEllipses to
+    // the per-point normal equations accumulated by the given worker; allocateNormalEquations must
+    // have been called first with the same nPoints.  As in computeEpochBatch, evaluating all points
+    // for one tile before moving on keeps its pixel positions and builder workspace in cache.
+    void accumulateNormalEquationsBatch(
+        int n, int worker,
+        std::vector<Epoch> const & tileEpochs,
+        int nPoints,
+        ndarray::Array<Pixel const,1,1> const & weights,
+        ndarray::Array<Pixel const,1,1> const & data
+    ) const {
+        for (int k = 0; k < nPoints; ++k) {
+            accumulateTile(tileEpochs[n], worker, batchEllipses[k], worker * nPoints + k, weights, data);
+        }
+    }
+
+    // Make sure there is zeroed workspace for accumulateNormalEquations (nPoints == 1) or
+    // accumulateNormalEquationsBatch: a tile per worker, and a Hessian and gradient for each
+    // combination of worker and point, with index (worker * nPoints + point).
+    void allocateNormalEquations(
+        std::vector<Epoch> const & tileEpochs,
+        int amplitudeDim,
+        int nPoints=1
+    ) const {
+        int maxPix = 0;
+        for (
+            std::vector<Epoch>::const_iterator i = tileEpochs.begin();
+            i != tileEpochs.end();
+            ++i
+        ) {
+            maxPix = std::max(maxPix, i->nPix);
+        }
+        if (tiles.empty() || tiles.front().getSize<0>() != maxPix
+            || tiles.front().getSize<1>() != amplitudeDim) {
+            tiles.resize(nThreads);
+            blocks.resize(nThreads);
+            for (int i = 0; i < nThreads; ++i) {
+                tiles[i] = ndarray::allocate(maxPix, amplitudeDim);
+                blocks[i].resize(maxPix, amplitudeDim);
+            }
+        }
+        hessians.assign(nThreads * nPoints, Matrix::Zero(amplitudeDim, amplitudeDim));
+        gradients.assign(nThreads * nPoints, Vector::Zero(amplitudeDim));
+    }
+
+    // Return true if the given term should be skipped for the given epoch.
+    bool isSkipped(Epoch const & epoch, int term, afw::geom::ellipses::Ellipse const & ellipse) const {
+        return truncationRadius > 0.0 && epoch.isNegligible(terms[term], ellipse, truncationRadius);
+    }
 
-    std::vector<Epoch> epochs;
+    UnitTransformedLikelihoodControl ctrl;
+    int nThreads;
+    ParallelForPool pool; // threads are started once here, and reused by every model evaluation
+    Scalar truncationRadius; // k, in units of sigma; zero to disable truncation
+    TermVector terms;
+    std::vector<Input> inputs; // empty after setup unless ctrl.keepUnbinnedPixels
+    std::vector<Epoch> epochs; // split into chunks of at most ctrl.maxChunkPixels (see addEpoch)
+    std::vector<TileSource> tileSources; // one per addEpoch call
+    // split into tiles of NORMAL_EQUATIONS_TILE_ROWS pixels; see getNormalEquationTiles()
+    mutable std::vector<Epoch> normalEquationTiles;
     Model::EllipseVector ellipses;
-    afw::geom::ellipses::Ellipse scratch;
+    std::vector<Model::EllipseVector> batchEllipses; // one per point, for computeModelMatrices
+    mutable std::vector<afw::geom::ellipses::Ellipse> scratch; // one per worker thread
+    // per-worker workspace for computeNormalEquations, allocated on first use
+    mutable std::vector< ndarray::Array<Pixel,2,-1> > tiles;
+    mutable std::vector<Matrix> blocks;
+    mutable std::vector<Matrix> hessians;
+    mutable std::vector<Vector> gradients;
+
+private:
+
+    // Fill a block with the (optionally weighted) rows of the model matrix for the given epoch.
+    void fillEpoch(
+        Epoch const & epoch, int worker,
+        Model::EllipseVector const & ellipses,
+        ndarray::Array<Pixel,2,-1> const & rows,
+        ndarray::Array<Pixel const,1,1> const & weights
+    ) const {
+        fillEpochUnscaled(epoch, worker, ellipses, rows);
+        rows.deep() *= epoch.transform.flux;
+        if (!weights.isEmpty()) {
+            rows.asEigen<Eigen::ArrayXpr>().colwise()
+                *= weights[ndarray::view(epoch.dataOffset, epoch.dataOffset + epoch.nPix)]
+                    .asEigen<Eigen::ArrayXpr>();
+        }
+    }
+
+    // Evaluate the (weighted) model matrix for the given tile using the given worker's workspace, and
+    // add its contribution to hessians[slot] and gradients[slot].
+    void accumulateTile(
+        Epoch const & epoch, int worker,
+        Model::EllipseVector const & ellipses,
+        int slot,
+        ndarray::Array<Pixel const,1,1> const & weights,
+        ndarray::Array<Pixel const,1,1> const & data
+    ) const {
+        ndarray::Array<Pixel,2,-1> rows = tiles[worker][ndarray::view(0, epoch.nPix)()];
+        fillEpoch(epoch, worker, ellipses, rows, weights);
+        // Cast the block to double once, and reuse it for both products.
+        Matrix & block = blocks[worker];
+        block.topRows(epoch.nPix) = rows.asEigen().cast<Scalar>();
+        hessians[slot].selfadjointView<Eigen::Lower>().rankUpdate(block.topRows(epoch.nPix).adjoint());
+        gradients[slot].noalias() += block.topRows(epoch.nPix).adjoint()
+            * data[ndarray::view(epoch.dataOffset, epoch.dataOffset + epoch.nPix)].asEigen().cast<Scalar>();
+    }
+
+    // Fill a block with the rows of the model matrix for the given epoch, without the flux scaling
+    // or pixel weights.
+    void fillEpochUnscaled(
+        Epoch const & epoch, int worker,
+        Model::EllipseVector const & ellipses,
+        ndarray::Array<Pixel,2,-1> const & rows
+    ) const {
+        rows.deep() = 0.0;
+        // MatrixBuilders add to their output, so terms split from the same basis accumulate.  Those
+        // terms are adjacent and share an ellipse, so we only transform it for the first of them.
+        for (std::size_t k = 0; k < terms.size(); ++k) {
+            if (k == 0 || terms[k].ellipse != terms[k - 1].ellipse) {
+                scratch[worker] = ellipses[terms[k].ellipse].transform(epoch.transform.geometric);
+            }
+            if (isSkipped(epoch, k, scratch[worker])) continue;
+            int amplitudeOffset = terms[k].amplitudeOffset;
+            int amplitudeEnd = amplitudeOffset + epoch.builders[k].getBasisSize();
+            epoch.builders[k](rows[ndarray::view()(amplitudeOffset, amplitudeEnd)], scratch[worker]);
+        }
+    }
 };
 
+UnitTransformedLikelihood::Impl * UnitTransformedLikelihood::makeImpl(
+    PTR(Model) model,
+    UnitTransformedLikelihoodControl const & ctrl
+) {
+    bool doTruncate = ctrl.truncationTolerance > 0.0;
+    if (doTruncate && ctrl.truncationTolerance >= 1.0) {
+        throw LSST_EXCEPT(
+            pex::exceptions::InvalidParameterError,
+            (boost::format("truncationTolerance must be < 1 (got %g)") % ctrl.truncationTolerance).str()
+        );
+    }
+    return new Impl(
+        ctrl,
+        makeBasisTerms(model->getBasisVector(), doTruncate),
+        doTruncate ? std::sqrt(-2.0 * std::log(ctrl.truncationTolerance)) : 0.0
+    );
+}
+
 UnitTransformedLikelihood::UnitTransformedLikelihood(
     PTR(Model) model,
     ndarray::Array<Scalar const,1,1> const & fixed,
@@ -165,35 +864,27 @@ UnitTransformedLikelihood::UnitTransformedLikelihood(
     afw::coord::Coord const & position,
     std::vector<PTR(EpochFootprint)> const & epochFootprintList,
     UnitTransformedLikelihoodControl const & ctrl
-) : Likelihood(model, fixed), _impl(new Impl()) {
-    int totPixels = std::accumulate(epochFootprintList.begin(), epochFootprintList.end(),
-                                    0, componentPixelSum);
-    _data = ndarray::allocate(totPixels);
-    _weights = ndarray::allocate(totPixels);
-    _impl->epochs.reserve(epochFootprintList.size());
-    _impl->ellipses = model->makeEllipseVector();
-    int dataOffset = 0;
+) : Likelihood(model, fixed), _impl(makeImpl(model, ctrl)) {
+    _impl->inputs.reserve(epochFootprintList.size());
     for (
         std::vector<PTR(EpochFootprint)>::const_iterator imPtrIter = epochFootprintList.begin();
         imPtrIter != epochFootprintList.end();
         ++imPtrIter
     ) {
-        int nPix = (**imPtrIter).footprint.getArea();
-        int dataEnd = dataOffset + nPix;
-        _impl->epochs.push_back(
-            Impl::Epoch(
-                nPix, LocalUnitTransform(position, fitSys, (**imPtrIter).exposure),
-                makeMatrixBuilders(model->getBasisVector(), (**imPtrIter).psf, (**imPtrIter).footprint)
+        EpochFootprint const & epochFootprint = **imPtrIter;
+        afw::image::MaskedImage<Pixel> const image = epochFootprint.exposure.getMaskedImage();
+        _impl->inputs.push_back(
+            Impl::Input(
+                epochFootprint.transformCache ?
+                    epochFootprint.transformCache->fromSystem(position, fitSys) :
+                    LocalUnitTransform(position, fitSys, epochFootprint.exposure),
+                epochFootprint.psf,
+                flattenPixels(image, selectPixels(epochFootprint.footprint, image, ctrl.badMaskPlanes))
             )
         );
-        setupArrays(
-            (**imPtrIter).exposure.getMaskedImage(),
-            (**imPtrIter).footprint,
-            _data[ndarray::view(dataOffset, dataEnd)],
-            _weights[ndarray::view(dataOffset, dataEnd)],
-            ctrl.usePixelWeights
-        );
     }
+    _impl->ellipses = model->makeEllipseVector();
+    _impl->setup(_data, _weights, 1);
 }
 
 UnitTransformedLikelihood::UnitTransformedLikelihood(
@@ -204,19 +895,69 @@ UnitTransformedLikelihood::UnitTransformedLikelihood(
     afw::image::Exposure<Pixel> const & exposure,
     afw::detection::Footprint const & footprint,
     shapelet::MultiShapeletFunction const & psf,
-    UnitTransformedLikelihoodControl const & ctrl
-) : Likelihood(model, fixed), _impl(new Impl()) {
-    int totPixels = footprint.getArea();
-    _data = ndarray::allocate(totPixels);
-    _weights = ndarray::allocate(totPixels);
-    _impl->ellipses = model->makeEllipseVector();
-    _impl->epochs.push_back(
-        Impl::Epoch(
-            totPixels, LocalUnitTransform(position, fitSys, exposure),
-            makeMatrixBuilders(model->getBasisVector(), psf, footprint)
+    UnitTransformedLikelihoodControl const & ctrl,
+    PTR(LocalUnitTransformCache) transformCache
+) : Likelihood(model, fixed), _impl(makeImpl(model, ctrl)) {
+    afw::image::MaskedImage<Pixel> const image = exposure.getMaskedImage();
+    _impl->inputs.push_back(
+        Impl::Input(
+            transformCache ?
+                transformCache->fromSystem(position, fitSys) : LocalUnitTransform(position, fitSys, exposure),
+            psf,
+            flattenPixels(image, selectPixels(footprint, image, ctrl.badMaskPlanes))
         )
     );
-    setupArrays(exposure.getMaskedImage(), footprint, _data, _weights, ctrl.usePixelWeights);
+    _impl->ellipses = model->makeEllipseVector();
+    _impl->setup(_data, _weights, 1);
+}
+
+UnitTransformedLikelihood::UnitTransformedLikelihood(UnitTransformedLikelihood const & other, int binFactor) :
+    Likelihood(other._model, other._fixed),
+    _impl(new Impl(other._impl->ctrl, other._impl->terms, other._impl->truncationRadius))
+{
+    if (binFactor < 1) {
+        throw LSST_EXCEPT(
+            pex::exceptions::InvalidParameterError,
+            (boost::format("binFactor must be >= 1 (got %d)") % binFactor).str()
+        );
+    }
+    if (!other.canDownsample()) {
+        throw LSST_EXCEPT(
+            pex::exceptions::LogicError,
+            "Likelihood cannot be downsampled; it must be constructed with keepUnbinnedPixels=true"
+        );
+    }
+    _impl->inputs = other._impl->inputs;
+    _impl->ellipses = _model->makeEllipseVector();
+    _impl->setup(_data, _weights, binFactor);
+}
+
+UnitTransformedLikelihood::UnitTransformedLikelihood(UnitTransformedLikelihood const & other) :
+    Likelihood(other._model, other._fixed),
+    _impl(new Impl(other._impl->ctrl, other._impl->terms, other._impl->truncationRadius))
+{
+    _data = other._data;
+    _weights = other._weights;
+    _impl->inputs = other._impl->inputs;
+    _impl->epochs.reserve(other._impl->epochs.size());
+    for (
+        std::vector<Impl::Epoch>::const_iterator i = other._impl->epochs.begin();
+        i != other._impl->epochs.end();
+        ++i
+    ) {
+        _impl->epochs.push_back(*i);
+    }
+    // normal equation tiles are rebuilt on first use, if needed
+    _impl->tileSources = other._impl->tileSources;
+    _impl->ellipses = _model->makeEllipseVector();
+}
+
+bool UnitTransformedLikelihood::canDownsample() const {
+    return !_impl->inputs.empty();
+}
+
+PTR(Likelihood) UnitTransformedLikelihood::clone() const {
+    return PTR(Likelihood)(new UnitTransformedLikelihood(*this));
 }
 
 UnitTransformedLikelihood::~UnitTransformedLikelihood() {}
@@ -227,29 +968,170 @@ void UnitTransformedLikelihood::computeModelMatrix(
     bool doApplyWeights
 ) const {
     getModel()->writeEllipses(nonlinear.begin(), _fixed.begin(), _impl->ellipses.begin());
-    int dataOffset = 0;
-    modelMatrix.deep() = 0.0;
-    for (
-        std::vector<Impl::Epoch>::const_iterator i = _impl->epochs.begin();
-        i != _impl->epochs.end();
-        ++i
-    ) {
-        int dataEnd = dataOffset + i->nPix;
-        int amplitudeOffset = 0;
-        for (std::size_t j = 0; j < _impl->ellipses.size(); ++j) {
-            _impl->scratch = _impl->ellipses[j].transform(i->transform.geometric);
-            int amplitudeEnd = amplitudeOffset + i->builders[j].getBasisSize();
-            i->builders[j](
-                modelMatrix[ndarray::view(dataOffset, dataEnd)(amplitudeOffset, amplitudeEnd)],
-                _impl->scratch
-            );
-            amplitudeOffset = amplitudeEnd;
+    // Each epoch (or chunk) writes a disjoint block of rows, so they can be computed in any order.
+    _impl->pool.run(
+        _impl->epochs.size(),
+        boost::bind(
+            &Impl::computeEpoch, _impl.get(), _1, _2, modelMatrix,
+            doApplyWeights ? ndarray::Array<Pixel const,1,1>(_weights) : ndarray::Array<Pixel const,1,1>()
+        )
+    );
+}
+
+void UnitTransformedLikelihood::computeModelMatrices(
+    ndarray::Array<Pixel,3,3> const & modelMatrices,
+    ndarray::Array<Scalar const,2,1> const & nonlinear,
+    bool doApplyWeights
+) const {
+    LSST_THROW_IF_NE(
+        modelMatrices.getSize<0>(), nonlinear.getSize<0>(),
+        pex::exceptions::LengthError,
+        "Number of model matrices (%d) does not match number of nonlinear parameter vectors (%d)"
+    );
+    int const nPoints = nonlinear.getSize<0>();
+    if (static_cast<int>(_impl->batchEllipses.size()) < nPoints) {
+        _impl->batchEllipses.resize(nPoints, getModel()->makeEllipseVector());
+    }
+    for (int k = 0; k < nPoints; ++k) {
+        getModel()->writeEllipses(nonlinear[k].begin(), _fixed.begin(), _impl->batchEllipses[k].begin());
+    }
+    _impl->pool.run(
+        _impl->epochs.size(),
+        boost::bind(
+            &Impl::computeEpochBatch, _impl.get(), _1, _2, modelMatrices,
+            doApplyWeights ? ndarray::Array<Pixel const,1,1>(_weights) : ndarray::Array<Pixel const,1,1>()
+        )
+    );
+}
+
+void UnitTransformedLikelihood::computeNormalEquations(
+    ndarray::Array<Scalar const,1,1> const & nonlinear,
+    ndarray::Array<Scalar,2,2> const & hessian,
+    ndarray::Array<Scalar,1,1> const & gradient
+) const {
+    getModel()->writeEllipses(nonlinear.begin(), _fixed.begin(), _impl->ellipses.begin());
+    std::vector<Impl::Epoch> const & tileEpochs = _impl->getNormalEquationTiles();
+    _impl->allocateNormalEquations(tileEpochs, getAmplitudeDim());
+    // Each worker accumulates its own partial sums, which we add up at the end.
+    _impl->pool.run(
+        tileEpochs.size(),
+        boost::bind(
+            &Impl::accumulateNormalEquations, _impl.get(), _1, _2, boost::cref(tileEpochs),
+            ndarray::Array<Pixel const,1,1>(_weights), ndarray::Array<Pixel const,1,1>(_data)
+        )
+    );
+    for (int i = 1; i < _impl->nThreads; ++i) {
+        _impl->hessians.front() += _impl->hessians[i];
+        _impl->gradients.front() += _impl->gradients[i];
+    }
+    hessian.asEigen() = _impl->hessians.front().selfadjointView<Eigen::Lower>();
+    gradient.asEigen() = _impl->gradients.front();
+}
+
+void UnitTransformedLikelihood::computeNormalEquationsBatch(
+    ndarray::Array<Scalar const,2,1> const & nonlinear,
+    ndarray::Array<Scalar,3,3> const & hessians,
+    ndarray::Array<Scalar,2,2> const & gradients
+) const {
+    LSST_THROW_IF_NE(
+        hessians.getSize<0>(), nonlinear.getSize<0>(),
+        pex::exceptions::LengthError,
+        "Number of Hessians (%d) does not match number of nonlinear parameter vectors (%d)"
+    );
+    LSST_THROW_IF_NE(
+        gradients.getSize<0>(), nonlinear.getSize<0>(),
+        pex::exceptions::LengthError,
+        "Number of gradients (%d) does not match number of nonlinear parameter vectors (%d)"
+    );
+    int const nPoints = nonlinear.getSize<0>();
+    if (static_cast<int>(_impl->batchEllipses.size()) < nPoints) {
+        _impl->batchEllipses.resize(nPoints, getModel()->makeEllipseVector());
+    }
+    for (int k = 0; k < nPoints; ++k) {
+        getModel()->writeEllipses(nonlinear[k].begin(), _fixed.begin(), _impl->batchEllipses[k].begin());
+    }
+    std::vector<Impl::Epoch> const & tileEpochs = _impl->getNormalEquationTiles();
+    _impl->allocateNormalEquations(tileEpochs, getAmplitudeDim(), nPoints);
+    _impl->pool.run(
+        tileEpochs.size(),
+        boost::bind(
+            &Impl::accumulateNormalEquationsBatch, _impl.get(), _1, _2, boost::cref(tileEpochs), nPoints,
+            ndarray::Array<Pixel const,1,1>(_weights), ndarray::Array<Pixel const,1,1>(_data)
+        )
+    );
+    for (int k = 0; k < nPoints; ++k) {
+        // add up the partial sums from each worker into the first worker's slot
+        for (int i = 1; i < _impl->nThreads; ++i) {
+            _impl->hessians[k] += _impl->hessians[i * nPoints + k];
+            _impl->gradients[k] += _impl->gradients[i * nPoints + k];
         }
-        modelMatrix[ndarray::view(dataOffset, dataEnd)()] *= i->transform.flux;
-        dataOffset = dataEnd;
+        hessians[k].asEigen() = _impl->hessians[k].selfadjointView<Eigen::Lower>();
+        gradients[k].asEigen() = _impl->gradients[k];
     }
-    if (doApplyWeights) {
-        modelMatrix.asEigen<Eigen::ArrayXpr>().colwise() *= _weights.asEigen<Eigen::ArrayXpr>();
+}
+
+void UnitTransformedLikelihood::computeModelMatrixDerivatives(
+    ndarray::Array<Pixel,3,3> const & derivatives,
+    ndarray::Array<Scalar const,1,1> const & nonlinear,
+    bool doApplyWeights,
+    ndarray::Array<Pixel const,2,-1> const & modelMatrix
+) const {
+    ndarray::Array<Pixel const,2,-1> base = modelMatrix;
+    if (base.isEmpty()) {
+        // this also sets _impl->ellipses
+        ndarray::Array<Pixel,2,-1> unperturbed = ndarray::allocate(getDataDim(), getAmplitudeDim());
+        computeModelMatrix(unperturbed, nonlinear, doApplyWeights);
+        base = unperturbed;
+    } else {
+        getModel()->writeEllipses(nonlinear.begin(), _fixed.begin(), _impl->ellipses.begin());
+    }
+    Model::EllipseVector perturbedEllipses = getModel()->makeEllipseVector();
+    ndarray::Array<Scalar,1,1> perturbed = ndarray::copy(nonlinear);
+    derivatives.deep() = 0.0;
+    for (int k = 0; k < getNonlinearDim(); ++k) {
+        perturbed[k] += computeNumDiffStep(nonlinear[k]);
+        Scalar step = perturbed[k] - nonlinear[k]; // make sure the step is exactly representable
+        getModel()->writeEllipses(perturbed.begin(), _fixed.begin(), perturbedEllipses.begin());
+        ndarray::Array<Pixel,2,-1> output = derivatives[k].transpose();
+        for (
+            std::vector<Impl::Epoch>::const_iterator i = _impl->epochs.begin();
+            i != _impl->epochs.end();
+            ++i
+        ) {
+            int dataOffset = i->dataOffset;
+            int dataEnd = dataOffset + i->nPix;
+            // Terms are grouped by ellipse, in order, so we difference each ellipse's block once all
+            // of its terms have been accumulated.
+            for (std::size_t t = 0; t < _impl->terms.size(); ++t) {
+                int j = _impl->terms[t].ellipse;
+                int amplitudeOffset = _impl->terms[t].amplitudeOffset;
+                int amplitudeEnd = amplitudeOffset + i->builders[t].getBasisSize();
+                // blocks for ellipses that don't depend on this parameter are left at zero
+                if (perturbedEllipses[j].getParameterVector() == _impl->ellipses[j].getParameterVector()) {
+                    continue;
+                }
+                ndarray::Array<Pixel,2,-1> block
+                    = output[ndarray::view(dataOffset, dataEnd)(amplitudeOffset, amplitudeEnd)];
+                // Use the unperturbed ellipse to decide whether to skip a term, so the perturbed and
+                // unperturbed model matrices always include the same terms.
+                _impl->scratch.front() = _impl->ellipses[j].transform(i->transform.geometric);
+                if (!_impl->isSkipped(*i, t, _impl->scratch.front())) {
+                    _impl->scratch.front() = perturbedEllipses[j].transform(i->transform.geometric);
+                    i->builders[t](block, _impl->scratch.front());
+                }
+                if (t + 1 == _impl->terms.size() || _impl->terms[t + 1].ellipse != j) {
+                    block.asEigen() *= static_cast<Pixel>(i->transform.flux);
+                    if (doApplyWeights) {
+                        block.asEigen<Eigen::ArrayXpr>().colwise()
+                            *= _weights[ndarray::view(dataOffset, dataEnd)].asEigen<Eigen::ArrayXpr>();
+                    }
+                    block.asEigen()
+                        -= base[ndarray::view(dataOffset, dataEnd)(amplitudeOffset, amplitudeEnd)].asEigen();
+                    block.asEigen() *= static_cast<Pixel>(1.0 / step);
+                }
+            }
+        }
+        perturbed[k] = nonlinear[k];
     }
 }
 
@@ -21,8 +21,13 @@
  * see <http://www.lsstcorp.org/LegalNotices/>.
  */
 
+#include <algorithm>
+#include <limits>
+
 #include "Eigen/Eigenvalues"
 #include "boost/math/special_functions/erf.hpp"
+#include "boost/bind.hpp"
+#include "boost/date_time/posix_time/posix_time_types.hpp"
 
 #include "ndarray/eigen.h"
 
@@ -36,6 +41,7 @@
 #include "lsst/meas/multifit/Likelihood.h"
 #include "lsst/meas/multifit/Prior.h"
 #include "lsst/meas/multifit/ModelFitRecord.h"
+#include "lsst/meas/multifit/parallel.h"
 
 namespace lsst { namespace meas { namespace multifit {
 
@@ -183,24 +189,159 @@ void OptimizerInterpreter::_unpackNonlinear(
     nonlinear.deep() = parameters[ndarray::view(0, getNonlinearDim())];
 }
 
+// ----------------- Memory reuse helpers -------------------------------------------------------------------
+
+namespace {
+
+// Return the first size elements of storage, reallocating it only if it is too small.
+template <typename T>
+ndarray::Array<T,1,1> reuseStorage(ndarray::Array<T,1,1> & storage, int size) {
+    if (storage.template getSize<0>() < size) {
+        storage = ndarray::allocate(size);
+    }
+    return storage[ndarray::view(0, size)];
+}
+
+// Return a row-major rows x cols array backed by storage, reallocating it only if it is too small.
+template <typename T>
+ndarray::Array<T,2,2> reuseRowMajorStorage(ndarray::Array<T,1,1> & storage, int rows, int cols) {
+    ndarray::Array<T,1,1> flat = reuseStorage(storage, rows*cols);
+    return ndarray::external(
+        flat.getData(), ndarray::makeVector(rows, cols), ndarray::makeVector(cols, 1), flat
+    );
+}
+
+} // anonymous
+
+// ----------------- OptimizerWorkspace ---------------------------------------------------------------------
+
+ndarray::Array<Pixel,2,-1> OptimizerWorkspace::getModelMatrix(int dataDim, int amplitudeDim) {
+    return reuseRowMajorStorage(_modelMatrixStorage, amplitudeDim, dataDim).transpose();
+}
+
 // ----------------- OptimizerObjective ---------------------------------------------------------------------
 
+namespace {
+
+// Maximum number of grid points passed to each call to computeResidualsBatch(); this bounds the
+// memory used for model matrices by objectives that evaluate them all at once.
+static int const GRID_BATCH_SIZE = 16;
+
+// Evaluates the likelihood term of the objective for one block of grid points, using a per-worker
+// objective and residual buffer; used with parallelFor by OptimizerObjective::fillObjectiveValueGrid.
+class ObjectiveGridBlockFunction {
+public:
+
+    ObjectiveGridBlockFunction(
+        int blockSize,
+        std::vector<OptimizerObjective const *> const & objectives,
+        std::vector< ndarray::Array<Scalar,2,2> > const & residuals,
+        ndarray::Array<Scalar const,2,1> const & grid,
+        ndarray::Array<Scalar,1,1> const & output
+    ) : _blockSize(blockSize), _objectives(objectives), _residuals(residuals), _grid(grid), _output(output)
+    {}
+
+    void operator()(int block, int worker) const {
+        OptimizerObjective const & objective = *_objectives[worker];
+        int const end = std::min((block + 1)*_blockSize, int(_output.getSize<0>()));
+        for (int i = block*_blockSize; i < end; i += GRID_BATCH_SIZE) {
+            int const nPoints = std::min(GRID_BATCH_SIZE, end - i);
+            ndarray::Array<Scalar,2,2> residuals = _residuals[worker][ndarray::view(0, nPoints)()];
+            objective.computeResidualsBatch(_grid[ndarray::view(i, i + nPoints)()], residuals);
+            for (int j = 0; j < nPoints; ++j) {
+                _output[i + j] = 0.5*residuals[j].asEigen().squaredNorm();
+            }
+        }
+    }
+
+private:
+    int _blockSize;
+    std::vector<OptimizerObjective const *> const & _objectives;
+    std::vector< ndarray::Array<Scalar,2,2> > const & _residuals;
+    ndarray::Array<Scalar const,2,1> _grid;
+    ndarray::Array<Scalar,1,1> _output;
+};
+
+} // anonymous
+
+void OptimizerObjective::computeResidualsBatch(
+    ndarray::Array<Scalar const,2,1> const & parameters,
+    ndarray::Array<Scalar,2,2> const & residuals
+) const {
+    LSST_THROW_IF_NE(
+        parameters.getSize<0>(), residuals.getSize<0>(),
+        pex::exceptions::LengthError,
+        "Number of parameter vectors (%d) does not match number of residual vectors (%d)"
+    );
+    for (int i = 0; i < parameters.getSize<0>(); ++i) {
+        computeResiduals(parameters[i], residuals[i]);
+    }
+}
+
 void OptimizerObjective::fillObjectiveValueGrid(
     ndarray::Array<Scalar const,2,1> const & grid,
     ndarray::Array<Scalar,1,1> const & output
 ) const {
-    ndarray::Array<Scalar,1,1> residuals = ndarray::allocate(dataSize);
-    for (int i = 0, n = output.getSize<0>(); i < n; ++i) {
-        computeResiduals(grid[i], residuals);
-        output[i] = 0.5*residuals.asEigen().squaredNorm();
-        if (hasPrior()) {
-            Scalar prior = computePrior(grid[i]);
-            if (prior <= 0.0) {
-                output[i] = std::numeric_limits<Scalar>::infinity();
-            } else {
-                output[i] -= std::log(prior);
-            }
+    fillObjectiveValueGrid(
+        grid, output, ndarray::Array<Scalar,1,1>(), ndarray::Array<Scalar,1,1>(), 1
+    );
+}
+
+void OptimizerObjective::fillObjectiveValueGrid(
+    ndarray::Array<Scalar const,2,1> const & grid,
+    ndarray::Array<Scalar,1,1> const & output,
+    ndarray::Array<Scalar,1,1> const & chiSquared,
+    ndarray::Array<Scalar,1,1> const & priorTerms,
+    int nThreads
+) const {
+    // number of blocks per thread; more than one so threads that finish early can pick up more work
+    static int const BLOCKS_PER_THREAD = 4;
+    int const n = output.getSize<0>();
+    if (grid.getSize<0>() != n
+        || (!chiSquared.isEmpty() && chiSquared.getSize<0>() != n)
+        || (!priorTerms.isEmpty() && priorTerms.getSize<0>() != n)) {
+        throw LSST_EXCEPT(
+            pex::exceptions::LengthError,
+            (boost::format("Number of grid points (%d) does not match output sizes")
+             % grid.getSize<0>()).str()
+        );
+    }
+    // clones are held by the vector of shared_ptrs; the workers use plain pointers so worker 0 can use this
+    std::vector<PTR(OptimizerObjective)> clones;
+    std::vector<OptimizerObjective const *> objectives(1, this);
+    for (int worker = 1; worker < nThreads; ++worker) {
+        PTR(OptimizerObjective) clone = this->clone();
+        if (!clone) {
+            clones.clear();
+            objectives.resize(1);
+            break;
+        }
+        clones.push_back(clone);
+        objectives.push_back(clone.get());
+    }
+    std::vector< ndarray::Array<Scalar,2,2> > residuals(objectives.size());
+    for (std::size_t worker = 0; worker < residuals.size(); ++worker) {
+        residuals[worker] = ndarray::allocate(std::min(n, GRID_BATCH_SIZE), dataSize);
+    }
+    ndarray::Array<Scalar,1,1> likelihoodTerms = chiSquared.isEmpty() ? output : chiSquared;
+    int const nBlocks = std::min(n, int(objectives.size())*BLOCKS_PER_THREAD);
+    if (nBlocks > 0) {
+        int const blockSize = (n + nBlocks - 1) / nBlocks;
+        parallelFor(
+            (n + blockSize - 1) / blockSize, int(objectives.size()),
+            ObjectiveGridBlockFunction(blockSize, objectives, residuals, grid, likelihoodTerms)
+        );
+    }
+    bool const doPrior = hasPrior();
+    for (int i = 0; i < n; ++i) {
+        Scalar priorTerm = 0.0;
+        if (doPrior) {
+            priorTerm = -computeLogPrior(grid[i]);
         }
+        if (!priorTerms.isEmpty()) {
+            priorTerms[i] = priorTerm;
+        }
+        output[i] = likelihoodTerms[i] + priorTerm;
     }
 }
 
@@ -209,13 +350,25 @@ namespace {
 class LikelihoodOptimizerObjective : public OptimizerObjective {
 public:
 
-    LikelihoodOptimizerObjective(PTR(Likelihood) likelihood, PTR(Prior) prior) :
+    LikelihoodOptimizerObjective(
+        PTR(Likelihood) likelihood,
+        PTR(Prior) prior,
+        ndarray::Array<Pixel,2,-1> const & modelMatrix,
+        int modelCacheSize
+    ) :
         OptimizerObjective(
             likelihood->getDataDim(), likelihood->getNonlinearDim() + likelihood->getAmplitudeDim()
         ),
         _likelihood(likelihood), _prior(prior),
-        _modelMatrix(ndarray::allocate(likelihood->getDataDim(), likelihood->getAmplitudeDim()))
-    {}
+        _modelMatrix(modelMatrix),
+        _modelCacheSize(std::max(modelCacheSize, 1)),
+        _modelCacheClock(0),
+        _modelCacheHits(0),
+        _modelCacheMisses(0)
+    {
+        _modelCache.reserve(_modelCacheSize);
+        _modelCache.push_back(ModelCacheEntry(modelMatrix, likelihood->getNonlinearDim()));
+    }
 
     virtual void computeResiduals(
         ndarray::Array<Scalar const,1,1> const & parameters,
@@ -223,14 +376,89 @@ public:
     ) const {
         int nlDim = _likelihood->getNonlinearDim();
         int ampDim = _likelihood->getAmplitudeDim();
-        _likelihood->computeModelMatrix(_modelMatrix, parameters[ndarray::view(0, nlDim)]);
+        _updateModelMatrix(parameters[ndarray::view(0, nlDim)]);
         residuals.asEigen() = _modelMatrix.asEigen().cast<Scalar>()
             * parameters[ndarray::view(nlDim, nlDim+ampDim)].asEigen();
         residuals.asEigen() -= _likelihood->getData().asEigen().cast<Scalar>();
     }
 
+    virtual void computeResidualsBatch(
+        ndarray::Array<Scalar const,2,1> const & parameters,
+        ndarray::Array<Scalar,2,2> const & residuals
+    ) const {
+        LSST_THROW_IF_NE(
+            parameters.getSize<0>(), residuals.getSize<0>(),
+            pex::exceptions::LengthError,
+            "Number of parameter vectors (%d) does not match number of residual vectors (%d)"
+        );
+        int nPoints = parameters.getSize<0>();
+        int nlDim = _likelihood->getNonlinearDim();
+        int ampDim = _likelihood->getAmplitudeDim();
+        // these points are generally not in the model cache (and would just evict it), so we bypass it
+        if (_batchModelMatrices.getSize<0>() != nPoints) {
+            _batchModelMatrices = ndarray::allocate(nPoints, ampDim, dataSize);
+        }
+        _likelihood->computeModelMatrices(_batchModelMatrices, parameters[ndarray::view()(0, nlDim)]);
+        for (int i = 0; i < nPoints; ++i) {
+            residuals[i].asEigen() = _batchModelMatrices[i].asEigen().adjoint().cast<Scalar>()
+                * parameters[i][ndarray::view(nlDim, nlDim+ampDim)].asEigen();
+            residuals[i].asEigen() -= _likelihood->getData().asEigen().cast<Scalar>();
+        }
+    }
+
+    virtual int differentiateLinearResiduals(
+        ndarray::Array<Scalar const,1,1> const & parameters,
+        ndarray::Array<Scalar,2,-2> const & jacobian
+    ) const {
+        int nlDim = _likelihood->getNonlinearDim();
+        int ampDim = _likelihood->getAmplitudeDim();
+        _updateModelMatrix(parameters[ndarray::view(0, nlDim)]);
+        jacobian.asEigen().rightCols(ampDim) = _modelMatrix.asEigen().cast<Scalar>();
+        return nlDim;
+    }
+
+    virtual bool hasResidualDerivatives() const { return true; }
+
+    virtual int differentiateResiduals(
+        ndarray::Array<Scalar const,1,1> const & parameters,
+        ndarray::Array<Scalar,2,-2> const & jacobian
+    ) const {
+        int nlDim = _likelihood->getNonlinearDim();
+        int ampDim = _likelihood->getAmplitudeDim();
+        ndarray::Array<Scalar const,1,1> nonlinear = parameters[ndarray::view(0, nlDim)];
+        ndarray::Array<Scalar const,1,1> amplitudes = parameters[ndarray::view(nlDim, nlDim+ampDim)];
+        // residuals are linear in the amplitudes, so those columns are just the model matrix; this
+        // also leaves _modelMatrix up to date, so the likelihood doesn't have to evaluate it again
+        differentiateLinearResiduals(parameters, jacobian);
+        if (_modelMatrixDerivatives.isEmpty()) {
+            _modelMatrixDerivatives = ndarray::allocate(ndarray::makeVector(nlDim, ampDim, dataSize));
+        }
+        _likelihood->computeModelMatrixDerivatives(_modelMatrixDerivatives, nonlinear, true, _modelMatrix);
+        for (int k = 0; k < nlDim; ++k) {
+            jacobian.asEigen().col(k) = _modelMatrixDerivatives[k].asEigen().adjoint().cast<Scalar>()
+                * amplitudes.asEigen();
+        }
+        // the model matrix derivatives are finite differences, with one perturbed model per
+        // nonlinear parameter; the unperturbed model matrix was already counted when it was computed
+        return nlDim;
+    }
+
     virtual bool hasPrior() const { return _prior; }
 
+    virtual PTR(OptimizerObjective) clone() const {
+        PTR(Likelihood) likelihood = _likelihood->clone();
+        if (!likelihood) return PTR(OptimizerObjective)();
+        return boost::make_shared<LikelihoodOptimizerObjective>(
+            likelihood, _prior,
+            ndarray::allocate(likelihood->getDataDim(), likelihood->getAmplitudeDim()),
+            _modelCacheSize
+        );
+    }
+
+    virtual int getModelCacheHits() const { return _modelCacheHits; }
+
+    virtual int getModelCacheMisses() const { return _modelCacheMisses; }
+
     virtual Scalar computePrior(ndarray::Array<Scalar const,1,1> const & parameters) const {
         int nlDim = _likelihood->getNonlinearDim();
         int ampDim = _likelihood->getAmplitudeDim();
@@ -257,19 +485,131 @@ public:
         );
     }
 
+    virtual Scalar computeLogPrior(ndarray::Array<Scalar const,1,1> const & parameters) const {
+        int nlDim = _likelihood->getNonlinearDim();
+        int ampDim = _likelihood->getAmplitudeDim();
+        return _prior->evaluateLog(parameters[ndarray::view(0, nlDim)],
+                                   parameters[ndarray::view(nlDim, nlDim+ampDim)]);
+    }
+
+    virtual void differentiateLogPrior(
+        ndarray::Array<Scalar const,1,1> const & parameters,
+        ndarray::Array<Scalar,1,1> const & gradient,
+        ndarray::Array<Scalar,2,1> const & hessian
+    ) const {
+        int nlDim = _likelihood->getNonlinearDim();
+        int ampDim = _likelihood->getAmplitudeDim();
+        int totDim = nlDim + ampDim;
+        _prior->evaluateLogDerivatives(
+            parameters[ndarray::view(0, nlDim)],
+            parameters[ndarray::view(nlDim, totDim)],
+            gradient[ndarray::view(0, nlDim)],
+            gradient[ndarray::view(nlDim, totDim)],
+            hessian[ndarray::view(0, nlDim)(0, nlDim)],
+            hessian[ndarray::view(nlDim, totDim)(nlDim, totDim)],
+            hessian[ndarray::view(0, nlDim)(nlDim, totDim)]
+        );
+    }
+
 private:
+
+    struct ModelCacheEntry {
+        ndarray::Array<Scalar,1,1> nonlinear; // nonlinear parameters the matrix was computed at
+        ndarray::Array<Pixel,2,-1> matrix;
+        long lastUsed;                        // value of _modelCacheClock when last looked up
+
+        ModelCacheEntry(ndarray::Array<Pixel,2,-1> const & matrix_, int nonlinearDim) :
+            nonlinear(ndarray::allocate(nonlinearDim)), matrix(matrix_), lastUsed(0)
+        {
+            // NaN never compares equal, so a new entry will never be mistaken for a hit
+            nonlinear.deep() = std::numeric_limits<Scalar>::quiet_NaN();
+        }
+    };
+
+    typedef std::vector<ModelCacheEntry> ModelCache;
+
+    // Point _modelMatrix at the model matrix for the given nonlinear parameters, computing it (and
+    // evicting the least-recently-used cache entry, if the cache is full) if it isn't cached.
+    void _updateModelMatrix(ndarray::Array<Scalar const,1,1> const & nonlinear) const {
+        ++_modelCacheClock;
+        ModelCache::iterator lru = _modelCache.begin();
+        for (ModelCache::iterator i = _modelCache.begin(); i != _modelCache.end(); ++i) {
+            if (i->nonlinear.asEigen() == nonlinear.asEigen()) {
+                ++_modelCacheHits;
+                i->lastUsed = _modelCacheClock;
+                _modelMatrix = i->matrix;
+                return;
+            }
+            if (i->lastUsed < lru->lastUsed) lru = i;
+        }
+        ++_modelCacheMisses;
+        if (lru->lastUsed > 0 && int(_modelCache.size()) < _modelCacheSize) {
+            // every existing entry holds a live matrix, and there's room for another
+            _modelCache.push_back(
+                ModelCacheEntry(
+                    ndarray::allocate(_likelihood->getDataDim(), _likelihood->getAmplitudeDim()),
+                    _likelihood->getNonlinearDim()
+                )
+            );
+            lru = _modelCache.end() - 1;
+        }
+        // Invalidate the entry before overwriting its matrix, so if computeModelMatrix throws, a
+        // partially-overwritten matrix is never returned for the entry's old parameters.
+        lru->nonlinear.deep() = std::numeric_limits<Scalar>::quiet_NaN();
+        lru->lastUsed = 0;
+        _likelihood->computeModelMatrix(lru->matrix, nonlinear);
+        lru->nonlinear.deep() = nonlinear;
+        lru->lastUsed = _modelCacheClock;
+        _modelMatrix = lru->matrix;
+    }
+
     PTR(Likelihood) _likelihood;
     PTR(Prior) _prior;
-    ndarray::Array<Pixel,2,-1> _modelMatrix;
+    mutable ndarray::Array<Pixel,2,-1> _modelMatrix; // view into the most recently used cache entry
+    int _modelCacheSize;
+    mutable ModelCache _modelCache;
+    mutable long _modelCacheClock;
+    mutable int _modelCacheHits;
+    mutable int _modelCacheMisses;
+    mutable ndarray::Array<Pixel,3,3> _modelMatrixDerivatives; // allocated on first use
+    mutable ndarray::Array<Pixel,3,3> _batchModelMatrices;     // for computeResidualsBatch()
 };
 
 } // anonymous
 
 PTR(OptimizerObjective) OptimizerObjective::makeFromLikelihood(
     PTR(Likelihood) likelihood,
-    PTR(Prior) prior
+    PTR(Prior) prior,
+    int modelCacheSize
 ) {
-    return boost::make_shared<LikelihoodOptimizerObjective>(likelihood, prior);
+    return boost::make_shared<LikelihoodOptimizerObjective>(
+        likelihood, prior,
+        ndarray::allocate(likelihood->getDataDim(), likelihood->getAmplitudeDim()),
+        modelCacheSize
+    );
+}
+
+PTR(OptimizerObjective) OptimizerObjective::makeFromLikelihood(
+    PTR(Likelihood) likelihood,
+    PTR(Prior) prior,
+    PTR(OptimizerWorkspace) workspace,
+    int modelCacheSize
+) {
+    return boost::make_shared<LikelihoodOptimizerObjective>(
+        likelihood, prior,
+        workspace->getModelMatrix(likelihood->getDataDim(), likelihood->getAmplitudeDim()),
+        modelCacheSize
+    );
+}
+
+int OptimizerObjective::differentiateResiduals(
+    ndarray::Array<Scalar const,1,1> const & parameters,
+    ndarray::Array<Scalar,2,-2> const & jacobian
+) const {
+    throw LSST_EXCEPT(
+        pex::exceptions::LogicError,
+        "Objective does not implement residual derivatives"
+    );
 }
 
 Scalar OptimizerObjective::computePrior(ndarray::Array<Scalar const,1,1> const & parameters) const {
@@ -285,19 +625,145 @@ void OptimizerObjective::differentiatePrior(
     hessian.deep() = 0.0;
 }
 
+Scalar OptimizerObjective::computeLogPrior(ndarray::Array<Scalar const,1,1> const & parameters) const {
+    Scalar p = computePrior(parameters);
+    if (p <= 0.0) {
+        return -std::numeric_limits<Scalar>::infinity();
+    }
+    return std::log(p);
+}
+
+void OptimizerObjective::differentiateLogPrior(
+    ndarray::Array<Scalar const,1,1> const & parameters,
+    ndarray::Array<Scalar,1,1> const & gradient,
+    ndarray::Array<Scalar,2,1> const & hessian
+) const {
+    Scalar p = computePrior(parameters);
+    differentiatePrior(parameters, gradient, hessian);
+    gradient.asEigen() /= p;
+    hessian.asEigen() /= p;
+    hessian.asEigen() -= gradient.asEigen() * gradient.asEigen().adjoint();
+}
+
+// ----------------- VariableProjectionOptimizerObjective ---------------------------------------------------
+
+VariableProjectionOptimizerObjective::VariableProjectionOptimizerObjective(
+    PTR(Likelihood) likelihood,
+    PTR(Prior) prior
+) :
+    OptimizerObjective(likelihood->getDataDim(), likelihood->getNonlinearDim()),
+    _likelihood(likelihood), _prior(prior),
+    _modelMatrix(ndarray::allocate(likelihood->getDataDim(), likelihood->getAmplitudeDim())),
+    _nonlinear(ndarray::allocate(likelihood->getNonlinearDim())),
+    _amplitudes(ndarray::allocate(likelihood->getAmplitudeDim())),
+    _amplitudeGradient(ndarray::allocate(likelihood->getAmplitudeDim())),
+    _amplitudeHessian(ndarray::allocate(likelihood->getAmplitudeDim(), likelihood->getAmplitudeDim())),
+    _crossHessian(ndarray::allocate(likelihood->getNonlinearDim(), likelihood->getAmplitudeDim())),
+    _gradient(likelihood->getAmplitudeDim()),
+    _hessian(likelihood->getAmplitudeDim(), likelihood->getAmplitudeDim())
+{
+    // NaN never compares equal, so the first call to _update will always compute everything
+    _nonlinear.deep() = std::numeric_limits<Scalar>::quiet_NaN();
+}
+
+void VariableProjectionOptimizerObjective::computeAmplitudes(
+    ndarray::Array<Scalar const,1,1> const & nonlinear,
+    ndarray::Array<Scalar,1,1> const & amplitudes
+) const {
+    _update(nonlinear);
+    amplitudes.deep() = _amplitudes;
+}
+
+void VariableProjectionOptimizerObjective::computeResiduals(
+    ndarray::Array<Scalar const,1,1> const & nonlinear,
+    ndarray::Array<Scalar,1,1> const & residuals
+) const {
+    _update(nonlinear);
+    residuals.asEigen() = _modelMatrix.asEigen().cast<Scalar>() * _amplitudes.asEigen();
+    residuals.asEigen() -= _likelihood->getData().asEigen().cast<Scalar>();
+}
+
+Scalar VariableProjectionOptimizerObjective::computePrior(
+    ndarray::Array<Scalar const,1,1> const & nonlinear
+) const {
+    _update(nonlinear);
+    return _prior->evaluate(nonlinear, _amplitudes);
+}
+
+void VariableProjectionOptimizerObjective::differentiatePrior(
+    ndarray::Array<Scalar const,1,1> const & nonlinear,
+    ndarray::Array<Scalar,1,1> const & gradient,
+    ndarray::Array<Scalar,2,1> const & hessian
+) const {
+    _update(nonlinear);
+    _prior->evaluateDerivatives(
+        nonlinear, _amplitudes,
+        gradient, _amplitudeGradient,
+        hessian, _amplitudeHessian, _crossHessian
+    );
+}
+
+Scalar VariableProjectionOptimizerObjective::computeLogPrior(
+    ndarray::Array<Scalar const,1,1> const & nonlinear
+) const {
+    _update(nonlinear);
+    return _prior->evaluateLog(nonlinear, _amplitudes);
+}
+
+void VariableProjectionOptimizerObjective::differentiateLogPrior(
+    ndarray::Array<Scalar const,1,1> const & nonlinear,
+    ndarray::Array<Scalar,1,1> const & gradient,
+    ndarray::Array<Scalar,2,1> const & hessian
+) const {
+    _update(nonlinear);
+    _prior->evaluateLogDerivatives(
+        nonlinear, _amplitudes,
+        gradient, _amplitudeGradient,
+        hessian, _amplitudeHessian, _crossHessian
+    );
+}
+
+PTR(OptimizerObjective) VariableProjectionOptimizerObjective::clone() const {
+    PTR(Likelihood) likelihood = _likelihood->clone();
+    if (!likelihood) return PTR(OptimizerObjective)();
+    return boost::make_shared<VariableProjectionOptimizerObjective>(likelihood, _prior);
+}
+
+void VariableProjectionOptimizerObjective::_update(ndarray::Array<Scalar const,1,1> const & nonlinear) const {
+    if (_nonlinear.asEigen() == nonlinear.asEigen()) return;
+    _likelihood->computeModelMatrix(_modelMatrix, nonlinear);
+    _hessian.setZero();
+    _hessian.selfadjointView<Eigen::Lower>().rankUpdate(_modelMatrix.asEigen().adjoint().cast<Scalar>());
+    _hessian = _hessian.selfadjointView<Eigen::Lower>();
+    _gradient = -(_modelMatrix.asEigen().adjoint() * _likelihood->getData().asEigen()).cast<Scalar>();
+    if (_prior) {
+        _prior->maximize(_gradient, _hessian, nonlinear, _amplitudes);
+    } else {
+        _amplitudes.asEigen() = _hessian.ldlt().solve(-_gradient);
+    }
+    _nonlinear.deep() = nonlinear;
+}
+
 // ----------------- OptimizerIterationData -----------------------------------------------------------------
 
 OptimizerIterationData::OptimizerIterationData(int dataSize, int parameterSize) :
-    objectiveValue(0.0), priorValue(0.0),
-    parameters(ndarray::allocate(parameterSize)),
-    residuals(ndarray::allocate(dataSize))
-{}
+    objectiveValue(0.0), priorValue(0.0)
+{
+    reset(dataSize, parameterSize);
+}
+
+void OptimizerIterationData::reset(int dataSize, int parameterSize) {
+    parameters = reuseStorage(_parameterStorage, parameterSize);
+    residuals = reuseStorage(_residualStorage, dataSize);
+}
 
 void OptimizerIterationData::swap(OptimizerIterationData & other) {
     std::swap(objectiveValue, other.objectiveValue);
     std::swap(priorValue, other.priorValue);
     parameters.swap(other.parameters);
     residuals.swap(other.residuals);
+    _parameterStorage.swap(other._parameterStorage);
+    _residualStorage.swap(other._residualStorage);
 }
 
 // ----------------- OptimizerHistoryRecorder ---------------------------------------------------------------
@@ -393,7 +859,7 @@ void OptimizerHistoryRecorder::apply(
             for (int i = 0, k = n; i < n; ++i) {
                 packed[i] = optimizer._gradient[i];
                 for (int j = 0; j <= i; ++j, ++k) {
-                    packed[k] = optimizer._hessian(i, j);
+                    packed[k] = optimizer._getHessianElement(i, j);
                 }
             }
         }
@@ -478,6 +944,138 @@ void OptimizerHistoryRecorder::fillObjectiveModelGrid(
     }
 }
 
+// ----------------- OptimizerHistoryBuffer -----------------------------------------------------------------
+
+OptimizerHistoryBuffer::OptimizerHistoryBuffer(int parameterSize, int capacity, bool doRecordDerivatives) :
+    _parameterSize(parameterSize), _size(0), _dropped(0), _next(0), _entries(capacity)
+{
+    if (capacity <= 0) {
+        throw LSST_EXCEPT(
+            pex::exceptions::InvalidParameterError,
+            (boost::format("History buffer capacity must be positive; got %d") % capacity).str()
+        );
+    }
+    _parameters = ndarray::allocate(capacity, parameterSize);
+    if (doRecordDerivatives) {
+        int const n = parameterSize;
+        _derivatives = ndarray::allocate(capacity, n + n*(n+1)/2);
+    }
+}
+
+void OptimizerHistoryBuffer::append(int outerIterCount, int innerIterCount, Optimizer const & optimizer) {
+    if (optimizer.getObjective()->parameterSize != _parameterSize) {
+        throw LSST_EXCEPT(
+            pex::exceptions::LengthError,
+            (boost::format("Optimizer parameter size (%d) does not match history buffer (%d)")
+             % optimizer.getObjective()->parameterSize % _parameterSize).str()
+        );
+    }
+    Entry & entry = _entries[_next];
+    entry.outer = outerIterCount;
+    entry.inner = innerIterCount;
+    entry.state = optimizer.getState();
+    entry.trust = optimizer._trustRadius;
+    OptimizerIterationData const * data;
+    if (!(optimizer.getState() & Optimizer::STATUS_STEP_REJECTED)) {
+        data = &optimizer._current;
+        if (!_derivatives.isEmpty()) {
+            int const n = _parameterSize;
+            ndarray::Array<Scalar,1,1> packed = _derivatives[_next];
+            for (int i = 0, k = n; i < n; ++i) {
+                packed[i] = optimizer._gradient[i];
+                for (int j = 0; j <= i; ++j, ++k) {
+                    packed[k] = optimizer._getHessianElement(i, j);
+                }
+            }
+        }
+    } else {
+        data = &optimizer._next;
+    }
+    _parameters[_next] = data->parameters;
+    entry.objective = data->objectiveValue;
+    entry.prior = data->priorValue;
+    if (++_next == getCapacity()) _next = 0;
+    if (_size < getCapacity()) {
+        ++_size;
+    } else {
+        ++_dropped;
+    }
+}
+
+void OptimizerHistoryBuffer::copyTo(
+    OptimizerHistoryRecorder const & recorder,
+    afw::table::BaseCatalog & history
+) const {
+    if (recorder.parameters.getSize() != _parameterSize) {
+        throw LSST_EXCEPT(
+            pex::exceptions::LengthError,
+            (boost::format("Recorder parameter size (%d) does not match history buffer (%d)")
+             % recorder.parameters.getSize() % _parameterSize).str()
+        );
+    }
+    if (recorder.derivatives.isValid() && _derivatives.isEmpty()) {
+        throw LSST_EXCEPT(
+            pex::exceptions::LogicError,
+            "HistoryBuffer was not configured to save derivatives"
+        );
+    }
+    history.reserve(history.size() + _size);
+    for (int n = 0, i = (_next - _size + getCapacity()) % getCapacity(); n < _size; ++n) {
+        Entry const & entry = _entries[i];
+        PTR(afw::table::BaseRecord) record = history.addNew();
+        record->set(recorder.outer, entry.outer);
+        record->set(recorder.inner, entry.inner);
+        record->set(recorder.state, entry.state);
+        record->set(recorder.trust, entry.trust);
+        record->set(recorder.objective, entry.objective);
+        record->set(recorder.prior, entry.prior);
+        record->set(recorder.parameters, _parameters[i]);
+        if (recorder.derivatives.isValid() && !(entry.state & Optimizer::STATUS_STEP_REJECTED)) {
+            record->set(recorder.derivatives, _derivatives[i]);
+        }
+        if (++i == getCapacity()) i = 0;
+    }
+}
+
+// ----------------- OptimizerStatistics ---------------------------------------------------------------------
+
+void OptimizerStatistics::reset() {
+    residualEvaluations = 0;
+    jacobianEvaluations = 0;
+    broydenUpdates = 0;
+    modelCacheHits = 0;
+    modelCacheMisses = 0;
+    outerIterations = 0;
+    innerIterations = 0;
+    rejectedSteps = 0;
+    modelTime = 0.0;
+    priorTime = 0.0;
+    trustRegionTime = 0.0;
+    conjugateGradientIterations = 0;
+}
+
+namespace {
+
+// Adds the wall-clock time between its construction and destruction to the given total, in seconds;
+// see OptimizerStatistics for why this uses universal_time() rather than a monotonic clock.
+class ScopedTimer {
+public:
+
+    explicit ScopedTimer(double & total) :
+        _total(total), _start(boost::posix_time::microsec_clock::universal_time())
+    {}
+
+    ~ScopedTimer() {
+        _total += 1E-6 * (boost::posix_time::microsec_clock::universal_time() - _start).total_microseconds();
+    }
+
+private:
+    double & _total;
+    boost::posix_time::ptime _start;
+};
+
+} // anonymous
+
 // ----------------- Optimizer ------------------------------------------------------------------------------
 
 Optimizer::Optimizer(
@@ -486,78 +1084,247 @@ Optimizer::Optimizer(
     Control const & ctrl
 ) :
     _state(0x0),
-    _objective(objective),
     _ctrl(ctrl),
     _trustRadius(ctrl.trustRegionInitialSize),
-    _current(objective->dataSize, objective->parameterSize),
-    _next(objective->dataSize, objective->parameterSize),
-    _step(ndarray::allocate(objective->parameterSize)),
-    _gradient(ndarray::allocate(objective->parameterSize)),
-    _hessian(ndarray::allocate(objective->parameterSize, objective->parameterSize)),
-    _jacobian(objective->dataSize, objective->parameterSize),
-    _sr1b(objective->parameterSize, objective->parameterSize),
-    _sr1v(objective->parameterSize),
-    _sr1jtr(objective->parameterSize)
+    _current(0, 0),
+    _next(0, 0),
+    _isHessianFactored(false),
+    _broydenUpdateCount(0),
+    _modelCacheHitsBaseline(0),
+    _modelCacheMissesBaseline(0),
+    _steihaugSolver(ctrl.conjugateGradientMaxIterations)
+{
+    reset(objective, parameters);
+}
+
+Optimizer::Optimizer(
+    PTR(Objective const) objective,
+    ndarray::Array<Scalar const,1,1> const & parameters,
+    Control const & ctrl,
+    ndarray::Array<Scalar const,2,1> const & hessian,
+    double trustRadius
+) :
+    _state(0x0),
+    _ctrl(ctrl),
+    _trustRadius(ctrl.trustRegionInitialSize),
+    _current(0, 0),
+    _next(0, 0),
+    _isHessianFactored(false),
+    _broydenUpdateCount(0),
+    _modelCacheHitsBaseline(0),
+    _modelCacheMissesBaseline(0),
+    _steihaugSolver(ctrl.conjugateGradientMaxIterations)
 {
+    reset(objective, parameters, hessian, trustRadius);
+}
+
+void Optimizer::reset(PTR(Objective const) objective, ndarray::Array<Scalar const,1,1> const & parameters) {
+    reset(objective, parameters, ndarray::Array<Scalar const,2,1>(), 0.0);
+}
+
+void Optimizer::reset(
+    PTR(Objective const) objective,
+    ndarray::Array<Scalar const,1,1> const & parameters,
+    ndarray::Array<Scalar const,2,1> const & hessian,
+    double trustRadius
+) {
     pex::logging::Debug log("meas.multifit.optimizer.Optimizer");
-    if (parameters.getSize<0>() != _objective->parameterSize) {
+    if (parameters.getSize<0>() != objective->parameterSize) {
         throw LSST_EXCEPT(
             pex::exceptions::LengthError,
             (boost::format("Parameter vector size (%d) does not match objective (%d)")
-             % parameters.getSize<0>() % _objective->parameterSize).str()
+             % parameters.getSize<0>() % objective->parameterSize).str()
+        );
+    }
+    if (!hessian.isEmpty()
+        && (hessian.getSize<0>() != objective->parameterSize
+            || hessian.getSize<1>() != objective->parameterSize)) {
+        throw LSST_EXCEPT(
+            pex::exceptions::LengthError,
+            (boost::format("Initial Hessian shape (%d x %d) does not match objective (%d)")
+             % hessian.getSize<0>() % hessian.getSize<1>() % objective->parameterSize).str()
         );
     }
+    int const dataSize = objective->dataSize;
+    int const parameterSize = objective->parameterSize;
+    _state = 0x0;
+    _objective = objective;
+    _trustRadius = (trustRadius > 0.0) ? trustRadius : _ctrl.trustRegionInitialSize;
+    _current.reset(dataSize, parameterSize);
+    _next.reset(dataSize, parameterSize);
+    ndarray::Array<Scalar,1,1> vectors = reuseStorage(_vectorStorage, 2*parameterSize);
+    _step = vectors[ndarray::view(0, parameterSize)];
+    _gradient = vectors[ndarray::view(parameterSize, 2*parameterSize)];
+    _hessian = reuseRowMajorStorage(_hessianStorage, parameterSize, parameterSize);
+    _jacobian = reuseRowMajorStorage(_jacobianStorage, parameterSize, dataSize).transpose();
+    _sr1b.resize(parameterSize, parameterSize);
+    _sr1v.resize(parameterSize);
+    _sr1jtr.resize(parameterSize);
     _current.parameters.deep() = parameters;
     _next.parameters.deep() = parameters;
-    _objective->computeResiduals(_current.parameters, _current.residuals);
+    _workerObjectives.clear();
+    for (int worker = 1; worker < _ctrl.numDiffThreads; ++worker) {
+        PTR(Objective const) clone = _objective->clone();
+        if (!clone) {
+            log.debug<7>("Objective cannot be cloned; computing numerical derivatives serially");
+            _workerObjectives.clear();
+            break;
+        }
+        _workerObjectives.push_back(clone);
+    }
+    _workerData.resize(std::min(_workerData.size(), _workerObjectives.size()), IterationData(0, 0));
+    for (IterationDataVector::iterator i = _workerData.begin(); i != _workerData.end(); ++i) {
+        i->reset(dataSize, parameterSize);
+    }
+    while (_workerData.size() < _workerObjectives.size()) {
+        _workerData.push_back(IterationData(dataSize, parameterSize));
+    }
+    if (!_numDiffPool || _numDiffPool->getThreadCount() != int(_workerObjectives.size()) + 1) {
+        _numDiffPool = boost::make_shared<ParallelForPool>(int(_workerObjectives.size()) + 1);
+    }
+    _statistics.reset();
+    _modelCacheHitsBaseline = _objective->getModelCacheHits();
+    _modelCacheMissesBaseline = _objective->getModelCacheMisses();
+    {
+        ScopedTimer timer(_statistics.modelTime);
+        _objective->computeResiduals(_current.parameters, _current.residuals);
+    }
+    ++_statistics.residualEvaluations;
+    _updateModelCacheStatistics();
     _current.objectiveValue = 0.5*_current.residuals.asEigen().squaredNorm();
     if (_objective->hasPrior()) {
-        _current.priorValue = _objective->computePrior(_current.parameters);
-        _current.objectiveValue -= std::log(_current.priorValue);
+        ScopedTimer timer(_statistics.priorTime);
+        Scalar logPrior = _objective->computeLogPrior(_current.parameters);
+        _current.priorValue = std::exp(logPrior);
+        _current.objectiveValue -= logPrior;
     }
     log.debug<7>("Initial objective value is %g", _current.objectiveValue);
     _sr1b.setZero();
+    _broydenUpdateCount = 0;
     _computeDerivatives();
     _hessian.asEigen() = _hessian.asEigen().selfadjointView<Eigen::Lower>();
+    if (!hessian.isEmpty()) {
+        log.debug<7>("Using initial Hessian from warm start");
+        Matrix target = hessian.asEigen();
+        if (_ctrl.doUseConjugateGradient) {
+            // _hessian doesn't include the Gauss-Newton term in this mode
+            target -= _jacobian.asEigen().adjoint() * _jacobian.asEigen();
+        }
+        if (!_ctrl.noSR1Term) {
+            // start with the SR1 correction that reproduces the given Hessian; subsequent updates
+            // only touch the lower triangle, so we symmetrize it to be safe.
+            _sr1b = target - _hessian.asEigen();
+            _sr1b = _sr1b.selfadjointView<Eigen::Lower>();
+        }
+        _hessian.asEigen() = target;
+    }
+    _isHessianFactored = false;
+}
+
+ndarray::Array<Scalar const,2,2> Optimizer::getHessian() const {
+    if (!_ctrl.doUseConjugateGradient) {
+        return _hessian;
+    }
+    ndarray::Array<Scalar,2,2> result = ndarray::copy(_hessian);
+    result.asEigen().selfadjointView<Eigen::Lower>().rankUpdate(_jacobian.asEigen().adjoint(), 1.0);
+    result.asEigen() = result.asEigen().selfadjointView<Eigen::Lower>();
+    return result;
 }
 
-void Optimizer::_computeDerivatives() {
-    _jacobian.setZero();
-    _next.parameters.deep() = _current.parameters;
-    for (int n = 0; n < _objective->parameterSize; ++n) {
-        double numDiffStep = _ctrl.numDiffRelStep * _next.parameters[n]
-            + _ctrl.numDiffTrustRadiusStep * _trustRadius
-            + _ctrl.numDiffAbsStep;
-        _next.parameters[n] += numDiffStep;
-        _objective->computeResiduals(_next.parameters, _next.residuals);
-        _jacobian.col(n) = (_next.residuals.asEigen() - _current.residuals.asEigen()) / numDiffStep;
-        _next.parameters[n] = _current.parameters[n];
+void Optimizer::_computeDerivatives(bool doUpdateJacobian) {
+    if (doUpdateJacobian) {
+        ++_statistics.jacobianEvaluations;
+        _broydenUpdateCount = 0;
+        _next.parameters.deep() = _current.parameters;
+        if (_ctrl.doUseResidualDerivatives && _objective->hasResidualDerivatives()) {
+            ScopedTimer timer(_statistics.modelTime);
+            _statistics.residualEvaluations
+                += _objective->differentiateResiduals(_current.parameters, _jacobian);
+        } else {
+            ScopedTimer timer(_statistics.modelTime);
+            int linearOffset = _objective->differentiateLinearResiduals(_current.parameters, _jacobian);
+            for (IterationDataVector::iterator i = _workerData.begin(); i != _workerData.end(); ++i) {
+                i->parameters.deep() = _current.parameters;
+            }
+            _numDiffPool->run(linearOffset, boost::bind(&Optimizer::_computeNumDiffColumn, this, _1, _2));
+            _statistics.residualEvaluations += linearOffset;
+        }
+        _updateModelCacheStatistics();
     }
     _gradient.deep() = 0.0;
     _hessian.deep() = 0.0;
     if (_objective->hasPrior()) {
-        _objective->differentiatePrior(_current.parameters, _gradient, _hessian);
-        // objective evaluates P(x); we want -ln P(x) and associated derivatives
-        _gradient.asEigen() /= -_current.priorValue;
-        _hessian.asEigen() /= -_current.priorValue;
-        _hessian.asEigen().selfadjointView<Eigen::Lower>().rankUpdate(_gradient.asEigen(), 1.0);
+        ScopedTimer timer(_statistics.priorTime);
+        _objective->differentiateLogPrior(_current.parameters, _gradient, _hessian);
+        // objective evaluates derivatives of ln P(x); we want those of -ln P(x)
+        _gradient.asEigen() *= -1.0;
+        _hessian.asEigen() *= -1.0;
     }
     if (!_ctrl.noSR1Term) {
-        _sr1jtr = _jacobian.adjoint() * _current.residuals.asEigen();
+        _sr1jtr = _jacobian.asEigen().adjoint() * _current.residuals.asEigen();
         _gradient.asEigen() += _sr1jtr;
     } else {
-        _gradient.asEigen() += _jacobian.adjoint() * _current.residuals.asEigen();
+        _gradient.asEigen() += _jacobian.asEigen().adjoint() * _current.residuals.asEigen();
+    }
+    if (!_ctrl.doUseConjugateGradient) {
+        _hessian.asEigen().selfadjointView<Eigen::Lower>().rankUpdate(_jacobian.asEigen().adjoint(), 1.0);
+    }
+}
+
+void Optimizer::_updateModelCacheStatistics() {
+    // Worker clones are created fresh in reset(), so only the primary objective needs a baseline.
+    _statistics.modelCacheHits = _objective->getModelCacheHits() - _modelCacheHitsBaseline;
+    _statistics.modelCacheMisses = _objective->getModelCacheMisses() - _modelCacheMissesBaseline;
+    for (std::vector<PTR(Objective const)>::const_iterator i = _workerObjectives.begin();
+         i != _workerObjectives.end(); ++i) {
+        _statistics.modelCacheHits += (**i).getModelCacheHits();
+        _statistics.modelCacheMisses += (**i).getModelCacheMisses();
     }
-    _hessian.asEigen().selfadjointView<Eigen::Lower>().rankUpdate(_jacobian.adjoint(), 1.0);
+}
+
+void Optimizer::_updateJacobianBroyden() {
+    ++_statistics.broydenUpdates;
+    ++_broydenUpdateCount;
+    // Reuse the old residuals in _next as workspace for (r_{k+1} - r_k - J_k s).
+    _next.residuals.asEigen() = _current.residuals.asEigen() - _next.residuals.asEigen();
+    _next.residuals.asEigen() -= _jacobian.asEigen() * _step.asEigen();
+    _jacobian.asEigen() += _next.residuals.asEigen() * _step.asEigen().adjoint()
+        / _step.asEigen().squaredNorm();
+}
+
+void Optimizer::_computeNumDiffColumn(int n, int worker) {
+    Objective const & objective = worker ? *_workerObjectives[worker - 1] : *_objective;
+    IterationData & data = worker ? _workerData[worker - 1] : _next;
+    double numDiffStep = _ctrl.numDiffRelStep * data.parameters[n]
+        + _ctrl.numDiffTrustRadiusStep * _trustRadius
+        + _ctrl.numDiffAbsStep;
+    data.parameters[n] += numDiffStep;
+    objective.computeResiduals(data.parameters, data.residuals);
+    _jacobian.asEigen().col(n) = (data.residuals.asEigen() - _current.residuals.asEigen()) / numDiffStep;
+    data.parameters[n] = _current.parameters[n];
 }
 
 bool Optimizer::_stepImpl(
     int outerIterCount,
     HistoryRecorder const * recorder,
-    afw::table::BaseCatalog * history
+    afw::table::BaseCatalog * history,
+    HistoryBuffer * buffer
 ) {
     pex::logging::Debug log("meas.multifit.optimizer.Optimizer");
+    ++_statistics.outerIterations;
     _state &= ~int(STATUS);
+    if (_broydenUpdateCount > 0
+        && _gradient.asEigen().lpNorm<Eigen::Infinity>() <= _ctrl.gradientThreshold) {
+        // don't trust a gradient computed from an approximate Jacobian to declare convergence
+        log.debug<10>("max(gradient)=%g below threshold with Broyden-updated Jacobian; recomputing",
+                      _gradient.asEigen().lpNorm<Eigen::Infinity>());
+        _computeDerivatives();
+        if (!_ctrl.noSR1Term) {
+            _hessian.asEigen() += _sr1b;
+        }
+        _hessian.asEigen() = _hessian.asEigen().selfadjointView<Eigen::Lower>();
+        _isHessianFactored = false;
+    }
     if (_gradient.asEigen().lpNorm<Eigen::Infinity>() <= _ctrl.gradientThreshold) {
         log.debug<7>("max(gradient)=%g below threshold; declaring convergence",
                      _gradient.asEigen().lpNorm<Eigen::Infinity>());
@@ -566,12 +1333,26 @@ bool Optimizer::_stepImpl(
     }
     for (int innerIterCount = 0; innerIterCount < _ctrl.maxInnerIterations; ++innerIterCount) {
         log.debug<10>("Starting inner iteration %d", innerIterCount);
+        ++_statistics.innerIterations;
         _state &= ~int(STATUS);
         _next.objectiveValue = 0.0;
         _next.priorValue = 1.0;
-        solveTrustRegion(
-            _step, _hessian, _gradient, _trustRadius, _ctrl.trustRegionSolverTolerance
-        );
+        if (_ctrl.doUseConjugateGradient) {
+            ScopedTimer timer(_statistics.trustRegionTime);
+            _steihaugSolver.solve(
+                _step, _hessian, _jacobian, _gradient, _trustRadius, _ctrl.conjugateGradientTolerance
+            );
+            _statistics.conjugateGradientIterations += _steihaugSolver.getIterations();
+        } else {
+            ScopedTimer timer(_statistics.trustRegionTime);
+            if (!_isHessianFactored) {
+                // The Hessian only changes when a step is accepted, so rejected steps (which just shrink
+                // the trust radius) can reuse its eigendecomposition.
+                _trustRegionSolver.setMatrix(_hessian);
+                _isHessianFactored = true;
+            }
+            _trustRegionSolver.solve(_step, _gradient, _trustRadius, _ctrl.trustRegionSolverTolerance);
+        }
         _next.parameters.asEigen() = _current.parameters.asEigen() + _step.asEigen();
         double stepLength = _step.asEigen().norm();
         if (utils::isnan(stepLength)) {
@@ -581,8 +1362,14 @@ bool Optimizer::_stepImpl(
         }
         log.debug<10>("Step has length %g", stepLength);
         if (_objective->hasPrior()) {
-            _next.priorValue = _objective->computePrior(_next.parameters);
-            if (_next.priorValue <= 0.0) {
+            Scalar logPrior = 0.0;
+            {
+                ScopedTimer timer(_statistics.priorTime);
+                logPrior = _objective->computeLogPrior(_next.parameters);
+            }
+            _next.priorValue = std::exp(logPrior);
+            if (logPrior == -std::numeric_limits<Scalar>::infinity()) {
+                ++_statistics.rejectedSteps;
                 _next.objectiveValue = std::numeric_limits<Scalar>::infinity();
                 log.debug<10>("Rejecting step due to zero prior");
                 if (stepLength < _trustRadius) {
@@ -602,17 +1389,25 @@ bool Optimizer::_stepImpl(
                     _state |= CONVERGED_TR_SMALL;
                     return false;
                 }
-                if (recorder) recorder->apply(outerIterCount, innerIterCount, *history, *this);
+                _recordHistory(outerIterCount, innerIterCount, recorder, history, buffer);
                 continue;
             }
-            _next.objectiveValue = -std::log(_next.priorValue);
+            _next.objectiveValue = -logPrior;
         }
-        _objective->computeResiduals(_next.parameters, _next.residuals);
+        {
+            ScopedTimer timer(_statistics.modelTime);
+            _objective->computeResiduals(_next.parameters, _next.residuals);
+        }
+        ++_statistics.residualEvaluations;
+        _updateModelCacheStatistics();
         _next.objectiveValue += 0.5*_next.residuals.asEigen().squaredNorm();
         double actualChange = _next.objectiveValue - _current.objectiveValue;
         double predictedChange = _step.asEigen().dot(
             _gradient.asEigen() + 0.5*_hessian.asEigen()*_step.asEigen()
         );
+        if (_ctrl.doUseConjugateGradient) {
+            predictedChange += 0.5*(_jacobian.asEigen()*_step.asEigen()).squaredNorm();
+        }
         double rho = actualChange / predictedChange;
         if (utils::isnan(rho)) {
             log.debug<10>("NaN encountered in rho");
@@ -628,7 +1423,14 @@ bool Optimizer::_stepImpl(
             if (!_ctrl.noSR1Term) {
                 _sr1v = -_sr1jtr;
             }
-            _computeDerivatives();
+            bool doBroyden = _broydenUpdateCount + 1 < _ctrl.jacobianRefreshInterval
+                && rho >= _ctrl.jacobianRefreshReductionRatio;
+            if (doBroyden) {
+                log.debug<10>("Updating Jacobian with Broyden step (%d since last full Jacobian)",
+                              _broydenUpdateCount + 1);
+                _updateJacobianBroyden();
+            }
+            _computeDerivatives(!doBroyden);
             if (!_ctrl.noSR1Term) {
                 _sr1v += _sr1jtr;
                 double vs = _sr1v.dot(_step.asEigen());
@@ -638,6 +1440,7 @@ bool Optimizer::_stepImpl(
                 _hessian.asEigen() += _sr1b;
             }
             _hessian.asEigen() = _hessian.asEigen().selfadjointView<Eigen::Lower>();
+            _isHessianFactored = false;
             if (
                 rho > _ctrl.trustRegionGrowReductionRatio &&
                 (stepLength/_trustRadius) > _ctrl.trustRegionGrowStepFraction
@@ -656,10 +1459,11 @@ bool Optimizer::_stepImpl(
                 log.debug<10>("Leaving trust radius unchanged at %g", _trustRadius);
                 _state |= STATUS_TR_UNCHANGED;
             }
-            if (recorder) recorder->apply(outerIterCount, innerIterCount, *history, *this);
+            _recordHistory(outerIterCount, innerIterCount, recorder, history, buffer);
             return true;
         }
         _state |= STATUS_STEP_REJECTED;
+        ++_statistics.rejectedSteps;
         log.debug<10>("Step rejected; test objective was %g, current is %g",
                       _next.objectiveValue, _current.objectiveValue);
         if (stepLength < _trustRadius) {
@@ -678,21 +1482,25 @@ bool Optimizer::_stepImpl(
                          _trustRadius, _ctrl.minTrustRadiusThreshold);
             return false;
         }
-        if (recorder) recorder->apply(outerIterCount, innerIterCount, *history, *this);
+        _recordHistory(outerIterCount, innerIterCount, recorder, history, buffer);
     }
     log.debug<7>("Max inner iteration number exceeded");
     _state |= FAILED_MAX_INNER_ITERATIONS;
     return false;
 }
 
-int Optimizer::_runImpl(HistoryRecorder const * recorder, afw::table::BaseCatalog * history) {
+int Optimizer::_runImpl(
+    HistoryRecorder const * recorder,
+    afw::table::BaseCatalog * history,
+    HistoryBuffer * buffer
+) {
     pex::logging::Debug log("meas.multifit.optimizer.Optimizer");
-    if (recorder) recorder->apply(-1, -1, *history, *this);
+    _recordHistory(-1, -1, recorder, history, buffer);
     int outerIterCount = 0;
     try {
         for (; outerIterCount < _ctrl.maxOuterIterations; ++outerIterCount) {
             log.debug<10>("Starting outer iteration %d", outerIterCount);
-            if (!_stepImpl(outerIterCount, recorder, history)) return outerIterCount;
+            if (!_stepImpl(outerIterCount, recorder, history, buffer)) return outerIterCount;
         }
         _state |= FAILED_MAX_OUTER_ITERATIONS;
         log.debug<7>("Max outer iteration number exceeded");
@@ -702,14 +1510,226 @@ int Optimizer::_runImpl(HistoryRecorder const * recorder, afw::table::BaseCatalo
     return outerIterCount;
 }
 
+// ----------------- BatchOptimizer -------------------------------------------------------------------------
+
+BatchOptimizer::BatchOptimizer(int parameterSize, Control const & ctrl, int nThreads) :
+    _parameterSize(parameterSize), _nThreads(nThreads), _outerIterCount(0), _ctrl(ctrl)
+{}
+
+int BatchOptimizer::add(PTR(Objective const) objective, ndarray::Array<Scalar const,1,1> const & parameters) {
+    return add(objective, parameters, ndarray::Array<Scalar const,2,1>(), 0.0);
+}
+
+int BatchOptimizer::add(
+    PTR(Objective const) objective,
+    ndarray::Array<Scalar const,1,1> const & parameters,
+    ndarray::Array<Scalar const,2,1> const & hessian,
+    double trustRadius
+) {
+    if (!_states.isEmpty()) {
+        throw LSST_EXCEPT(
+            pex::exceptions::LogicError,
+            "Cannot add problems to a BatchOptimizer after it has started"
+        );
+    }
+    if (objective->parameterSize != _parameterSize) {
+        throw LSST_EXCEPT(
+            pex::exceptions::LengthError,
+            (boost::format("Objective parameter size (%d) does not match batch (%d)")
+             % objective->parameterSize % _parameterSize).str()
+        );
+    }
+    if (parameters.getSize<0>() != _parameterSize) {
+        throw LSST_EXCEPT(
+            pex::exceptions::LengthError,
+            (boost::format("Parameter vector size (%d) does not match batch (%d)")
+             % parameters.getSize<0>() % _parameterSize).str()
+        );
+    }
+    if (!hessian.isEmpty()
+        && (hessian.getSize<0>() != _parameterSize || hessian.getSize<1>() != _parameterSize)) {
+        throw LSST_EXCEPT(
+            pex::exceptions::LengthError,
+            (boost::format("Initial Hessian shape (%d x %d) does not match batch (%d)")
+             % hessian.getSize<0>() % hessian.getSize<1>() % _parameterSize).str()
+        );
+    }
+    // The arguments have been validated, so anything the Optimizer constructor throws comes from
+    // evaluating the objective, and only means this problem has failed.
+    PTR(Optimizer) optimizer;
+    try {
+        optimizer = boost::make_shared<Optimizer>(objective, parameters, _ctrl, hessian, trustRadius);
+    } catch (...) {
+        pex::logging::Debug log("meas.multifit.optimizer.BatchOptimizer");
+        log.debug<7>("Problem %d threw during initialization; marking it as failed", _optimizers.size());
+    }
+    // a null Optimizer marks a problem that failed during initialization; see _initialize()
+    _optimizers.push_back(optimizer);
+    return _optimizers.size() - 1;
+}
+
+Optimizer const & BatchOptimizer::getOptimizer(int index) const {
+    PTR(Optimizer) const & optimizer = _optimizers.at(index);
+    if (!optimizer) {
+        throw LSST_EXCEPT(
+            pex::exceptions::LogicError,
+            (boost::format("Problem %d failed during initialization, and has no Optimizer") % index).str()
+        );
+    }
+    return *optimizer;
+}
+
+void BatchOptimizer::_initialize() {
+    int const n = _optimizers.size();
+    _pool = boost::make_shared<ParallelForPool>(std::min(_nThreads, n));
+    _states = ndarray::allocate(n);
+    _objectiveValues = ndarray::allocate(n);
+    _parameters = ndarray::allocate(n, _parameterSize);
+    _active.reserve(n);
+    _stepResults.resize(n, 0);
+    for (int i = 0; i < n; ++i) {
+        if (!_optimizers[i]) {
+            _states[i] = Optimizer::FAILED_EXCEPTION;
+            _objectiveValues[i] = std::numeric_limits<Scalar>::quiet_NaN();
+            _parameters[i].asEigen().setConstant(std::numeric_limits<Scalar>::quiet_NaN());
+            continue;
+        }
+        _states[i] = _optimizers[i]->getState();
+        _objectiveValues[i] = _optimizers[i]->getObjectiveValue();
+        _parameters[i] = _optimizers[i]->getParameters();
+        _active.push_back(i);
+    }
+}
+
+void BatchOptimizer::_stepOne(int index) {
+    int k = _active[index];
+    Optimizer & optimizer = *_optimizers[k];
+    try {
+        _stepResults[k] = optimizer._stepImpl(_outerIterCount);
+    } catch (...) {
+        optimizer._state |= Optimizer::FAILED_EXCEPTION;
+        _stepResults[k] = false;
+    }
+}
+
+int BatchOptimizer::step() {
+    if (_states.isEmpty()) _initialize();
+    if (_active.empty()) return 0;
+    if (_outerIterCount >= _ctrl.maxOuterIterations) {
+        for (std::vector<int>::const_iterator i = _active.begin(); i != _active.end(); ++i) {
+            _optimizers[*i]->_state |= Optimizer::FAILED_MAX_OUTER_ITERATIONS;
+            _states[*i] = _optimizers[*i]->getState();
+        }
+        _active.clear();
+        return 0;
+    }
+    _pool->run(int(_active.size()), boost::bind(&BatchOptimizer::_stepOne, this, _1));
+    ++_outerIterCount;
+    // update the output arrays, and compact the active list to remove finished problems
+    std::vector<int>::iterator out = _active.begin();
+    for (std::vector<int>::const_iterator i = _active.begin(); i != _active.end(); ++i) {
+        Optimizer const & optimizer = *_optimizers[*i];
+        _states[*i] = optimizer.getState();
+        _objectiveValues[*i] = optimizer.getObjectiveValue();
+        _parameters[*i] = optimizer.getParameters();
+        if (_stepResults[*i]) {
+            *out = *i;
+            ++out;
+        }
+    }
+    _active.erase(out, _active.end());
+    return _active.size();
+}
+
+int BatchOptimizer::run() {
+    while (step() > 0);
+    return _outerIterCount;
+}
+
+bool BatchOptimizer::retire(int index) {
+    if (_states.isEmpty()) _initialize();
+    std::vector<int>::iterator i = std::find(_active.begin(), _active.end(), index);
+    if (i == _active.end()) return false;
+    _active.erase(i);
+    return true;
+}
+
+// ----------------- MultiStartOptimizer --------------------------------------------------------------------
+
+MultiStartOptimizer::MultiStartOptimizer(
+    int parameterSize,
+    Control const & ctrl,
+    double abandonThreshold,
+    int nThreads
+) :
+    _abandonThreshold(abandonThreshold), _bestIndex(-1), _batch(parameterSize, ctrl, nThreads)
+{}
+
+int MultiStartOptimizer::run() {
+    pex::logging::Debug log("meas.multifit.optimizer.MultiStartOptimizer");
+    _abandoned.assign(_batch.getSize(), 0);
+    // The batch's state arrays aren't allocated until its first step, so the first chance to compare
+    // (and abandon) starts is after that step.
+    while (_batch.step() > 0) {
+        _update();
+    }
+    _update();
+    log.debug<7>("Best start is %d of %d (%d abandoned)", _bestIndex, _batch.getSize(), getAbandonedCount());
+    return _bestIndex;
+}
+
+void MultiStartOptimizer::_update() {
+    pex::logging::Debug log("meas.multifit.optimizer.MultiStartOptimizer");
+    ndarray::Array<int const,1,1> states = _batch.getStates();
+    ndarray::Array<Scalar const,1,1> objectiveValues = _batch.getObjectiveValues();
+    _bestIndex = -1;
+    for (int i = 0, n = _batch.getSize(); i < n; ++i) {
+        if (_abandoned[i] || (states[i] & Optimizer::FAILED)) continue;
+        if (_bestIndex < 0 || objectiveValues[i] < objectiveValues[_bestIndex]) {
+            _bestIndex = i;
+        }
+    }
+    if (_bestIndex < 0) return;
+    Scalar const limit = objectiveValues[_bestIndex] + _abandonThreshold;
+    for (int i = 0, n = _batch.getSize(); i < n; ++i) {
+        if (!_abandoned[i] && objectiveValues[i] > limit && _batch.retire(i)) {
+            log.debug<7>("Abandoning start %d with objective %g; best is %g",
+                         i, objectiveValues[i], objectiveValues[_bestIndex]);
+            _abandoned[i] = 1;
+        }
+    }
+}
+
+Optimizer const & MultiStartOptimizer::getBest() const {
+    if (_bestIndex < 0) {
+        throw LSST_EXCEPT(
+            pex::exceptions::LogicError,
+            "No successful start available; either run() has not been called or all starts failed"
+        );
+    }
+    return _batch.getOptimizer(_bestIndex);
+}
+
+int MultiStartOptimizer::getAbandonedCount() const {
+    return std::count(_abandoned.begin(), _abandoned.end(), 1);
+}
 
 // ----------------- Trust Region solver --------------------------------------------------------------------
 
-void solveTrustRegion(
+namespace {
+
+// Solve the trust region subproblem given the eigendecomposition F = Q diag(lambda) Q^T; qtg and tmp are
+// workspace vectors with the same size as g.  Templated so the same code can be used with fixed-size
+// Eigen objects (for small problems, avoiding heap allocation) and with the dynamic-size decomposition
+// cached by TrustRegionSolver.
+template <typename EigenvectorsT, typename EigenvaluesT, typename VectorT>
+void solveTrustRegionEigen(
     ndarray::Array<Scalar,1,1> const & x,
-    ndarray::Array<Scalar const,2,1> const & F,
+    EigenvectorsT const & Q,
+    EigenvaluesT const & lambda,
     ndarray::Array<Scalar const,1,1> const & g,
-    double r, double tolerance
+    double r, double tolerance,
+    VectorT & qtg, VectorT & tmp
 ) {
     static double const ROOT_EPS = std::sqrt(std::numeric_limits<double>::epsilon());
     static int const ITER_MAX = 10;
@@ -718,16 +1738,15 @@ void solveTrustRegion(
     double const r2min = r2 * (1.0 - tolerance) * (1.0 - tolerance);
     double const r2max = r2 * (1.0 + tolerance) * (1.0 + tolerance);
     int const d = g.getSize<0>();
-    Eigen::SelfAdjointEigenSolver<Matrix> eigh(F.asEigen());
-    double const threshold = ROOT_EPS * eigh.eigenvalues()[d - 1];
-    Vector qtg = eigh.eigenvectors().adjoint() * g.asEigen();
-    Vector tmp(d);
+    double const threshold = ROOT_EPS * lambda[d - 1];
+    qtg.noalias() = Q.adjoint() * g.asEigen();
+    tmp.setZero();
     double mu = 0.0;
     double xsn = 0.0;
-    if (eigh.eigenvalues()[0] >= threshold) {
+    if (lambda[0] >= threshold) {
         log.debug<10>("Starting with full-rank matrix");
-        tmp = (eigh.eigenvalues().array().inverse() * qtg.array()).matrix();
-        x.asEigen() = -eigh.eigenvectors() * tmp;
+        tmp = (lambda.array().inverse() * qtg.array()).matrix();
+        x.asEigen().noalias() = -Q * tmp;
         xsn = x.asEigen().squaredNorm();
         if (xsn <= r2max) {
             log.debug<10>("Ending with unconstrained solution");
@@ -735,13 +1754,13 @@ void solveTrustRegion(
             return;
         }
     } else {
-        mu = -eigh.eigenvalues()[0] + 2.0*ROOT_EPS*eigh.eigenvalues()[d - 1];
-        tmp = ((eigh.eigenvalues().array() + mu).inverse() * qtg.array()).matrix();
+        mu = -lambda[0] + 2.0*ROOT_EPS*lambda[d - 1];
+        tmp = ((lambda.array() + mu).inverse() * qtg.array()).matrix();
         int n = 0;
-        while (eigh.eigenvalues()[++n] < threshold);
+        while (lambda[++n] < threshold);
         log.debug<10>("Starting with %d zero eigenvalue(s) (of %d)", n, d);
-        if ((qtg.head(n).array() < ROOT_EPS * g.asEigen().lpNorm<Eigen::Infinity>()).all()) {
-            x.asEigen() = -eigh.eigenvectors().rightCols(n) * tmp.tail(n);
+        if ((qtg.head(n).array() < ROOT_EPS * g.asEigen().template lpNorm<Eigen::Infinity>()).all()) {
+            x.asEigen().noalias() = -Q.rightCols(n) * tmp.tail(n);
             xsn = x.asEigen().squaredNorm();
             if (xsn < r2min) {
                 // Nocedal and Wright's "Hard Case", which is actually
@@ -752,13 +1771,13 @@ void solveTrustRegion(
                 // to get ||x|| == r.  If ||x|| > r, we can find the
                 // solution with the usual iteration by increasing \mu.
                 double tau = std::sqrt(r*r - x.asEigen().squaredNorm());
-                x.asEigen() += tau * eigh.eigenvectors().col(0);
+                x.asEigen() += tau * Q.col(0);
                 log.debug<10>("Ending; Q_1^T g == 0, and ||x|| < r");
                 return;
             }
             log.debug<10>("Continuing; Q_1^T g == 0, but ||x|| > r");
         } else {
-            x.asEigen() = -eigh.eigenvectors() * tmp;
+            x.asEigen().noalias() = -Q * tmp;
             xsn = x.asEigen().squaredNorm();
             log.debug<10>("Continuing; Q_1^T g != 0, ||x||=%f");
         }
@@ -767,13 +1786,202 @@ void solveTrustRegion(
     while ((xsn < r2min || xsn > r2max) && ++nIter < ITER_MAX) {
         log.debug<10>("Iterating at mu=%f, ||x||=%f, r=%f", mu, std::sqrt(xsn), r);
         mu += xsn*(std::sqrt(xsn) / r - 1.0)
-            / (qtg.array().square() / (eigh.eigenvalues().array() + mu).cube()).sum();
-        tmp = ((eigh.eigenvalues().array() + mu).inverse() * qtg.array()).matrix();
-        x.asEigen() = -eigh.eigenvectors() * tmp;
+            / (qtg.array().square() / (lambda.array() + mu).cube()).sum();
+        tmp = ((lambda.array() + mu).inverse() * qtg.array()).matrix();
+        x.asEigen().noalias() = -Q * tmp;
         xsn = x.asEigen().squaredNorm();
     }
     log.debug<10>("Ending at mu=%f, ||x||=%f, r=%f", mu, std::sqrt(xsn), r);
     return;
 }
 
+// Implementation of solveTrustRegion, templated on the (possibly dynamic) dimension of the problem so we
+// can use fixed-size Eigen objects (and hence avoid heap allocation) for small problems.
+template <int N>
+void solveTrustRegionImpl(
+    ndarray::Array<Scalar,1,1> const & x,
+    ndarray::Array<Scalar const,2,1> const & F,
+    ndarray::Array<Scalar const,1,1> const & g,
+    double r, double tolerance
+) {
+    typedef Eigen::Matrix<Scalar,N,N> MatrixN;
+    typedef Eigen::Matrix<Scalar,N,1> VectorN;
+    int const d = g.getSize<0>();
+    Eigen::SelfAdjointEigenSolver<MatrixN> eigh(MatrixN(F.asEigen()));
+    VectorN qtg(d);
+    VectorN tmp(d);
+    solveTrustRegionEigen(x, eigh.eigenvectors(), eigh.eigenvalues(), g, r, tolerance, qtg, tmp);
+}
+
+// Eigendecomposition used by TrustRegionSolver::setMatrix, templated for the same reason as
+// solveTrustRegionImpl; the results are copied into dynamic-size objects, which are only reallocated
+// when the dimension changes.
+template <int N>
+void decomposeTrustRegionMatrix(
+    ndarray::Array<Scalar const,2,1> const & F,
+    Matrix & eigenvectors,
+    Vector & eigenvalues
+) {
+    typedef Eigen::Matrix<Scalar,N,N> MatrixN;
+    Eigen::SelfAdjointEigenSolver<MatrixN> eigh(MatrixN(F.asEigen()));
+    eigenvectors = eigh.eigenvectors();
+    eigenvalues = eigh.eigenvalues();
+}
+
+typedef void (*TrustRegionSolverFunction)(
+    ndarray::Array<Scalar,1,1> const &,
+    ndarray::Array<Scalar const,2,1> const &,
+    ndarray::Array<Scalar const,1,1> const &,
+    double, double
+);
+
+typedef void (*TrustRegionDecompositionFunction)(
+    ndarray::Array<Scalar const,2,1> const &,
+    Matrix &,
+    Vector &
+);
+
+// Dispatch tables for fixed-size specializations, indexed by dimension.
+TrustRegionSolverFunction const FIXED_SIZE_TRUST_REGION_SOLVERS[] = {
+    &solveTrustRegionImpl<Eigen::Dynamic>,
+    &solveTrustRegionImpl<1>,  &solveTrustRegionImpl<2>,  &solveTrustRegionImpl<3>,
+    &solveTrustRegionImpl<4>,  &solveTrustRegionImpl<5>,  &solveTrustRegionImpl<6>,
+    &solveTrustRegionImpl<7>,  &solveTrustRegionImpl<8>,  &solveTrustRegionImpl<9>,
+    &solveTrustRegionImpl<10>, &solveTrustRegionImpl<11>, &solveTrustRegionImpl<12>,
+    &solveTrustRegionImpl<13>, &solveTrustRegionImpl<14>, &solveTrustRegionImpl<15>,
+    &solveTrustRegionImpl<16>
+};
+
+TrustRegionDecompositionFunction const FIXED_SIZE_TRUST_REGION_DECOMPOSITIONS[] = {
+    &decomposeTrustRegionMatrix<Eigen::Dynamic>,
+    &decomposeTrustRegionMatrix<1>,  &decomposeTrustRegionMatrix<2>,  &decomposeTrustRegionMatrix<3>,
+    &decomposeTrustRegionMatrix<4>,  &decomposeTrustRegionMatrix<5>,  &decomposeTrustRegionMatrix<6>,
+    &decomposeTrustRegionMatrix<7>,  &decomposeTrustRegionMatrix<8>,  &decomposeTrustRegionMatrix<9>,
+    &decomposeTrustRegionMatrix<10>, &decomposeTrustRegionMatrix<11>, &decomposeTrustRegionMatrix<12>,
+    &decomposeTrustRegionMatrix<13>, &decomposeTrustRegionMatrix<14>, &decomposeTrustRegionMatrix<15>,
+    &decomposeTrustRegionMatrix<16>
+};
+
+int const MAX_FIXED_SIZE_TRUST_REGION_DIM = 16;
+
+} // anonymous
+
+void solveTrustRegion(
+    ndarray::Array<Scalar,1,1> const & x,
+    ndarray::Array<Scalar const,2,1> const & F,
+    ndarray::Array<Scalar const,1,1> const & g,
+    double r, double tolerance
+) {
+    int const d = g.getSize<0>();
+    if (d <= MAX_FIXED_SIZE_TRUST_REGION_DIM) {
+        FIXED_SIZE_TRUST_REGION_SOLVERS[d](x, F, g, r, tolerance);
+    } else {
+        solveTrustRegionImpl<Eigen::Dynamic>(x, F, g, r, tolerance);
+    }
+}
+
+void TrustRegionSolver::setMatrix(ndarray::Array<Scalar const,2,1> const & F) {
+    int const d = F.getSize<0>();
+    if (F.getSize<1>() != d) {
+        throw LSST_EXCEPT(
+            pex::exceptions::LengthError,
+            (boost::format("Trust region matrix must be square; got %d x %d") % d % F.getSize<1>()).str()
+        );
+    }
+    if (d <= MAX_FIXED_SIZE_TRUST_REGION_DIM) {
+        FIXED_SIZE_TRUST_REGION_DECOMPOSITIONS[d](F, _eigenvectors, _eigenvalues);
+    } else {
+        decomposeTrustRegionMatrix<Eigen::Dynamic>(F, _eigenvectors, _eigenvalues);
+    }
+    _qtg.resize(d);
+    _tmp.resize(d);
+}
+
+void TrustRegionSolver::solve(
+    ndarray::Array<Scalar,1,1> const & x,
+    ndarray::Array<Scalar const,1,1> const & g,
+    double r, double tolerance
+) {
+    if (g.getSize<0>() != _eigenvalues.size() || x.getSize<0>() != _eigenvalues.size()) {
+        throw LSST_EXCEPT(
+            pex::exceptions::LengthError,
+            (boost::format("Vector sizes (%d, %d) do not match trust region matrix dimension (%d)")
+             % x.getSize<0>() % g.getSize<0>() % _eigenvalues.size()).str()
+        );
+    }
+    solveTrustRegionEigen(x, _eigenvectors, _eigenvalues, g, r, tolerance, _qtg, _tmp);
+}
+
+namespace {
+
+// Return the nonnegative tau for which ||x + tau*d|| == r, assuming ||x|| <= r.
+template <typename VectorT>
+Scalar moveToTrustRegionBoundary(VectorT const & x, Vector const & d, double r) {
+    Scalar dd = d.squaredNorm();
+    Scalar xd = x.dot(d);
+    Scalar xx = x.squaredNorm();
+    return (-xd + std::sqrt(std::max(xd*xd + dd*(r*r - xx), 0.0))) / dd;
+}
+
+} // anonymous
+
+void SteihaugSolver::solve(
+    ndarray::Array<Scalar,1,1> const & x,
+    ndarray::Array<Scalar const,2,1> const & H,
+    ndarray::Array<Scalar const,2,-2> const & J,
+    ndarray::Array<Scalar const,1,1> const & g,
+    double r, double tolerance
+) {
+    int const n = g.getSize<0>();
+    if (x.getSize<0>() != n || H.getSize<0>() != n || H.getSize<1>() != n
+        || (!J.isEmpty() && J.getSize<1>() != n)) {
+        throw LSST_EXCEPT(
+            pex::exceptions::LengthError,
+            (boost::format("Inconsistent trust region problem dimensions: x=%d, H=%dx%d, J=%dx%d, g=%d")
+             % x.getSize<0>() % H.getSize<0>() % H.getSize<1>() % J.getSize<0>() % J.getSize<1>()
+             % n).str()
+        );
+    }
+    int const maxIterations = (_maxIterations > 0) ? _maxIterations : n;
+    _residual.resize(n);
+    _direction.resize(n);
+    _product.resize(n);
+    if (!J.isEmpty()) {
+        _dataWorkspace.resize(J.getSize<0>());
+    }
+    x.deep() = 0.0;
+    _residual = g.asEigen();
+    _direction = -_residual;
+    _iterations = 0;
+    Scalar const threshold = tolerance * _residual.norm();
+    Scalar rr = _residual.squaredNorm();
+    if (std::sqrt(rr) <= threshold) return;
+    while (_iterations < maxIterations) {
+        ++_iterations;
+        _product.noalias() = H.asEigen() * _direction;
+        if (!J.isEmpty()) {
+            _dataWorkspace.noalias() = J.asEigen() * _direction;
+            _product.noalias() += J.asEigen().adjoint() * _dataWorkspace;
+        }
+        Scalar dBd = _direction.dot(_product);
+        if (dBd <= 0.0) {
+            // negative curvature: the model decreases without bound along d, so go to the boundary
+            x.asEigen() += moveToTrustRegionBoundary(x.asEigen(), _direction, r) * _direction;
+            return;
+        }
+        Scalar alpha = rr / dBd;
+        if ((x.asEigen() + alpha * _direction).norm() >= r) {
+            x.asEigen() += moveToTrustRegionBoundary(x.asEigen(), _direction, r) * _direction;
+            return;
+        }
+        x.asEigen() += alpha * _direction;
+        _residual += alpha * _product;
+        Scalar rrNext = _residual.squaredNorm();
+        if (std::sqrt(rrNext) <= threshold) return;
+        _direction *= rrNext / rr;
+        _direction -= _residual;
+        rr = rrNext;
+    }
+}
+
 }}} // namespace lsst::meas::multifit
@@ -0,0 +1,108 @@
+// -*- lsst-c++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2008-2013 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+#include "boost/bind.hpp"
+
+#include "lsst/meas/multifit/parallel.h"
+
+namespace lsst { namespace meas { namespace multifit {
+
+ParallelForPool::ParallelForPool(int nThreads) :
+    _nThreads(std::max(nThreads, 1)), _size(0), _next(0), _generation(0), _nBusy(0), _isShutdown(false)
+{
+    for (int worker = 1; worker < _nThreads; ++worker) {
+        _threads.create_thread(boost::bind(&ParallelForPool::_wait, this, worker));
+    }
+}
+
+ParallelForPool::~ParallelForPool() {
+    {
+        boost::mutex::scoped_lock lock(_mutex);
+        _isShutdown = true;
+    }
+    _startCondition.notify_all();
+    _threads.join_all();
+}
+
+void ParallelForPool::_run(int size, boost::function<void (int, int)> const & function) {
+    {
+        boost::mutex::scoped_lock lock(_mutex);
+        _function = function;
+        _size = size;
+        _next = 0;
+        _error = boost::exception_ptr();
+        _nBusy = _nThreads - 1;
+        ++_generation;
+    }
+    _startCondition.notify_all();
+    _work(0);
+    boost::mutex::scoped_lock lock(_mutex);
+    while (_nBusy > 0) {
+        _doneCondition.wait(lock);
+    }
+    _function.clear();
+    if (_error) {
+        boost::exception_ptr error = _error;
+        _error = boost::exception_ptr();
+        boost::rethrow_exception(error);
+    }
+}
+
+void ParallelForPool::_wait(int worker) {
+    int generation = 0;
+    while (true) {
+        {
+            boost::mutex::scoped_lock lock(_mutex);
+            while (_generation == generation && !_isShutdown) {
+                _startCondition.wait(lock);
+            }
+            if (_isShutdown) return;
+            generation = _generation;
+        }
+        _work(worker);
+        boost::mutex::scoped_lock lock(_mutex);
+        if (--_nBusy == 0) {
+            _doneCondition.notify_all();
+        }
+    }
+}
+
+void ParallelForPool::_work(int worker) {
+    try {
+        while (true) {
+            int i = 0;
+            {
+                boost::mutex::scoped_lock lock(_mutex);
+                if (_next >= _size) return;
+                i = _next++;
+            }
+            _function(i, worker);
+        }
+    } catch (...) {
+        boost::mutex::scoped_lock lock(_mutex);
+        if (!_error) _error = boost::current_exception();
+        _next = _size; // stop other workers from starting new iterations
+    }
+}
+
+}}} // namespace lsst::meas::multifit
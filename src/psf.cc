@@ -219,6 +219,13 @@ public:
     virtual Scalar evaluate(
         ndarray::Array<Scalar const,1,1> const & nonlinear,
         ndarray::Array<Scalar const,1,1> const & amplitudes
+    ) const {
+        return std::exp(evaluateLog(nonlinear, amplitudes));
+    }
+
+    virtual Scalar evaluateLog(
+        ndarray::Array<Scalar const,1,1> const & nonlinear,
+        ndarray::Array<Scalar const,1,1> const & amplitudes
     ) const {
         Scalar z = 0;
         ndarray::Array<Scalar const,1,1>::Iterator nonlinearIter = nonlinear.begin();
@@ -239,7 +246,7 @@ public:
             }
         }
         assert(nonlinearIter == nonlinear.end());
-        return std::exp(-0.5*z);
+        return -0.5*z;
     }
 
     virtual void evaluateDerivatives(
@@ -252,6 +259,26 @@ public:
         ndarray::Array<Scalar,2,1> const & crossHessian
     ) const {
         Scalar p = evaluate(nonlinear, amplitudes);
+        evaluateLogDerivatives(
+            nonlinear, amplitudes,
+            nonlinearGradient, amplitudeGradient,
+            nonlinearHessian, amplitudeHessian, crossHessian
+        );
+        nonlinearHessian.asEigen().selfadjointView<Eigen::Lower>().rankUpdate(nonlinearGradient.asEigen());
+        nonlinearHessian.asEigen() = nonlinearHessian.asEigen().selfadjointView<Eigen::Lower>();
+        nonlinearGradient.asEigen() *= p;
+        nonlinearHessian.asEigen() *= p;
+    }
+
+    virtual void evaluateLogDerivatives(
+        ndarray::Array<Scalar const,1,1> const & nonlinear,
+        ndarray::Array<Scalar const,1,1> const & amplitudes,
+        ndarray::Array<Scalar,1,1> const & nonlinearGradient,
+        ndarray::Array<Scalar,1,1> const & amplitudeGradient,
+        ndarray::Array<Scalar,2,1> const & nonlinearHessian,
+        ndarray::Array<Scalar,2,1> const & amplitudeHessian,
+        ndarray::Array<Scalar,2,1> const & crossHessian
+    ) const {
         int n = 0;
         nonlinearHessian.deep() = 0.0;
         for (ComponentIterator i = _components.begin(); i != _components.end(); ++i) {
@@ -277,10 +304,6 @@ public:
                 }
             }
         }
-        nonlinearHessian.asEigen().selfadjointView<Eigen::Lower>().rankUpdate(nonlinearGradient.asEigen());
-        nonlinearHessian.asEigen() = nonlinearHessian.asEigen().selfadjointView<Eigen::Lower>();
-        nonlinearGradient.asEigen() *= p;
-        nonlinearHessian.asEigen() *= p;
         amplitudeGradient.deep() = 0.0;
         amplitudeHessian.deep() = 0.0;
         crossHessian.deep() = 0.0;
@@ -339,7 +362,7 @@ ComponentVector vectorizeComponents(PsfFitterControl const & ctrl) {
 } // anonymous
 
 PsfFitter::PsfFitter(PsfFitterControl const & ctrl) :
-    _ctrl(ctrl)
+    _ctrl(ctrl), _workspace(boost::make_shared<OptimizerWorkspace>())
 {
     if (_ctrl.primary.order < 0) {
         throw LSST_EXCEPT(
@@ -433,7 +456,7 @@ shapelet::MultiShapeletFunction PsfFitter::apply(
     afw::image::Image<Pixel> const & image,
     afw::geom::ellipses::Quadrupole const & moments,
     Scalar noiseSigma
-) const {
+) {
     if (noiseSigma <= 0) {
         noiseSigma = _ctrl.defaultNoiseSigma;
     }
@@ -446,7 +469,7 @@ shapelet::MultiShapeletFunction PsfFitter::apply(
     afw::image::Image<Pixel> const & image,
     shapelet::MultiShapeletFunction const & initial,
     Scalar noiseSigma
-) const {
+) {
     if (noiseSigma <= 0) {
         noiseSigma = _ctrl.defaultNoiseSigma;
     }
@@ -462,10 +485,15 @@ shapelet::MultiShapeletFunction PsfFitter::apply(
     PTR(Likelihood) likelihood = boost::make_shared<MultiShapeletPsfLikelihood>(
         image.getArray(), image.getXY0(), _model, noiseSigma, fixed
     );
-    PTR(OptimizerObjective) objective = OptimizerObjective::makeFromLikelihood(likelihood, _prior);
-    Optimizer optimizer(objective, parameters, _ctrl.optimizer);
-    optimizer.run();
-    parameters.deep() = optimizer.getParameters(); // this sets nonlinear, amplitudes, because they're views
+    PTR(OptimizerObjective) objective
+        = OptimizerObjective::makeFromLikelihood(likelihood, _prior, _workspace);
+    if (!_optimizer) {
+        _optimizer = boost::make_shared<Optimizer>(objective, parameters, _ctrl.optimizer);
+    } else {
+        _optimizer->reset(objective, parameters);
+    }
+    _optimizer->run();
+    parameters.deep() = _optimizer->getParameters(); // this sets nonlinear, amplitudes, because they're views
     return _model->makeShapeletFunction(nonlinear, amplitudes, fixed);
 }
 
@@ -480,22 +508,25 @@ public:
         Model::BasisVector const & basisVector,
         Scalar sigma
     ) : _ellipses(ellipses),
+        _factories(),
         _builders(),
         _sigma(sigma)
     {
-        FactoryVector factories;
-        factories.reserve(basisVector.size());
-        _builders.reserve(basisVector.size());
-        int workspaceSize = 0;
+        _factories.reserve(basisVector.size());
         for (Model::BasisVector::const_iterator i = basisVector.begin(); i != basisVector.end(); ++i) {
-            factories.push_back(shapelet::MatrixBuilderFactory<Pixel>(x, y, **i));
-            workspaceSize = std::max(workspaceSize, factories.back().computeWorkspace());
-        }
-        shapelet::MatrixBuilderWorkspace<Pixel> workspace(workspaceSize);
-        for (FactoryVector::const_iterator i = factories.begin(); i != factories.end(); ++i) {
-            shapelet::MatrixBuilderWorkspace<Pixel> wsCopy(workspace); // share workspace between builders
-            _builders.push_back((*i)(wsCopy));
+            _factories.push_back(shapelet::MatrixBuilderFactory<Pixel>(x, y, **i));
         }
+        _makeBuilders();
+    }
+
+    // Builders share workspace, so copies get new builders from the same factories.
+    Impl(Impl const & other) :
+        _ellipses(other._ellipses),
+        _factories(other._factories),
+        _builders(),
+        _sigma(other._sigma)
+    {
+        _makeBuilders();
     }
 
     void computeModelMatrix(
@@ -520,7 +551,21 @@ private:
     typedef std::vector< shapelet::MatrixBuilder<Pixel> > BuilderVector;
     typedef std::vector< shapelet::MatrixBuilderFactory<Pixel> > FactoryVector;
 
+    void _makeBuilders() {
+        _builders.reserve(_factories.size());
+        int workspaceSize = 0;
+        for (FactoryVector::const_iterator i = _factories.begin(); i != _factories.end(); ++i) {
+            workspaceSize = std::max(workspaceSize, i->computeWorkspace());
+        }
+        shapelet::MatrixBuilderWorkspace<Pixel> workspace(workspaceSize);
+        for (FactoryVector::const_iterator i = _factories.begin(); i != _factories.end(); ++i) {
+            shapelet::MatrixBuilderWorkspace<Pixel> wsCopy(workspace); // share workspace between builders
+            _builders.push_back((*i)(wsCopy));
+        }
+    }
+
     Model::EllipseVector _ellipses;
+    FactoryVector _factories;
     BuilderVector _builders;
     Scalar _sigma;
 };
@@ -561,6 +606,17 @@ void MultiShapeletPsfLikelihood::computeModelMatrix(
     return _impl->computeModelMatrix(modelMatrix, nonlinear, _fixed, *getModel());
 }
 
+MultiShapeletPsfLikelihood::MultiShapeletPsfLikelihood(MultiShapeletPsfLikelihood const & other) :
+    Likelihood(other._model, other._fixed), _impl(new Impl(*other._impl))
+{
+    _data = other._data;
+    _weights = other._weights;
+}
+
+PTR(Likelihood) MultiShapeletPsfLikelihood::clone() const {
+    return PTR(Likelihood)(new MultiShapeletPsfLikelihood(*this));
+}
+
 MultiShapeletPsfLikelihood::~MultiShapeletPsfLikelihood() {}
 
 }}} // namespace lsst::meas::multifit
@@ -174,6 +174,40 @@ class MixtureTestCase(lsst.utils.tests.TestCase):
         for x in numpy.random.randn(10, t.getDimension()):
             doTest(t, x)
 
+    def testLogDerivatives(self):
+        g = self.makeRandomMixture(3, 4)
+        t = self.makeRandomMixture(4, 3, df=4.0)
+        def doTest(mixture, point):
+            n = mixture.getDimension()
+            p = mixture.evaluate(point)
+            self.assertClose(mixture.evaluateLog(point), numpy.log(p), rtol=1E-10)
+            gradient = numpy.zeros(n, dtype=float)
+            hessian = numpy.zeros((n,n), dtype=float)
+            mixture.evaluateDerivatives(point, gradient, hessian)
+            expectedGradient = gradient / p
+            expectedHessian = hessian / p - numpy.outer(expectedGradient, expectedGradient)
+            logGradient = numpy.zeros(n, dtype=float)
+            logHessian = numpy.zeros((n,n), dtype=float)
+            mixture.evaluateLogDerivatives(point, logGradient, logHessian)
+            self.assertClose(logGradient, expectedGradient, rtol=1E-8, atol=1E-12)
+            self.assertClose(logHessian, expectedHessian, rtol=1E-8, atol=1E-12)
+
+        for x in numpy.random.randn(10, g.getDimension()):
+            doTest(g, x)
+
+        for x in numpy.random.randn(10, t.getDimension()):
+            doTest(t, x)
+
+        # far from all components, the Gaussian mixture underflows but its log should not
+        far = numpy.zeros(g.getDimension(), dtype=float) + 1E3
+        self.assertEqual(g.evaluate(far), 0.0)
+        self.assertTrue(numpy.isfinite(g.evaluateLog(far)))
+        logGradient = numpy.zeros(g.getDimension(), dtype=float)
+        logHessian = numpy.zeros((g.getDimension(), g.getDimension()), dtype=float)
+        g.evaluateLogDerivatives(far, logGradient, logHessian)
+        self.assertTrue(numpy.isfinite(logGradient).all())
+        self.assertTrue(numpy.isfinite(logHessian).all())
+
 
 def suite():
     """Returns a suite containing all the test cases in this module."""
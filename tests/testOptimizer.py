@@ -28,12 +28,58 @@ import numpy
 
 import lsst.utils.tests
 import lsst.pex.logging
+import lsst.pex.exceptions
+import lsst.afw.geom
+import lsst.afw.image
 import lsst.meas.multifit
 
 numpy.random.seed(500)
 
 log = lsst.pex.logging.Debug("meas.multifit.optimizer", 10)
 
+class ToyProblem(object):
+    """A small nonlinear least-squares problem: fitting a noise-free image of an elliptical double
+    Gaussian with the two-component, fixed-center PsfFitter model that generated it.
+
+    Starting points are the true parameters plus an offset in the nonlinear parameters, with unit
+    amplitudes.
+    """
+
+    def __init__(self, noiseSigma=0.01):
+        config = lsst.meas.multifit.PsfFitterConfig()
+        config.primary.positionPriorSigma = 0.0
+        config.wings.positionPriorSigma = 0.0
+        self.fitter = lsst.meas.multifit.PsfFitter(config.makeControl())
+        self.model = self.fitter.getModel()
+        self.prior = self.fitter.getPrior()
+        self.nonlinearDim = self.model.getNonlinearDim()
+        ellipses = self.model.makeEllipseVector()
+        ellipses[0].setParameterVector(numpy.array([0.1, -0.05, 0.8, 0.0, 0.0]))
+        ellipses[1].setParameterVector(numpy.array([0.05, -0.02, 1.6, 0.0, 0.0]))
+        nonlinear = numpy.zeros(self.nonlinearDim, dtype=lsst.meas.multifit.Scalar)
+        self.fixed = numpy.zeros(self.model.getFixedDim(), dtype=lsst.meas.multifit.Scalar)
+        self.model.readEllipses(ellipses, nonlinear, self.fixed)
+        amplitudes = numpy.array([1.0, 0.2], dtype=lsst.meas.multifit.Scalar)
+        self.truth = numpy.concatenate([nonlinear, amplitudes])
+        image = lsst.afw.image.ImageD(lsst.afw.geom.Box2I(lsst.afw.geom.Point2I(-20, -20),
+                                                          lsst.afw.geom.Extent2I(41, 41)))
+        self.model.makeShapeletFunction(nonlinear, amplitudes, self.fixed).evaluate().addToImage(image)
+        self.likelihood = lsst.meas.multifit.MultiShapeletPsfLikelihood(
+            image.getArray().astype(lsst.meas.multifit.Pixel), image.getXY0(), self.model, noiseSigma,
+            self.fixed
+            )
+
+    def makeObjective(self, likelihood=None):
+        if likelihood is None:
+            likelihood = self.likelihood
+        return lsst.meas.multifit.OptimizerObjective.makeFromLikelihood(likelihood, self.prior)
+
+    def makeStart(self, offset):
+        start = self.truth.copy()
+        start[:self.nonlinearDim] += offset
+        start[self.nonlinearDim:] = 1.0
+        return start
+
 class OptimizerTestCase(lsst.utils.tests.TestCase):
 
     def testTrustRegionSolver(self):
@@ -70,6 +116,282 @@ class OptimizerTestCase(lsst.utils.tests.TestCase):
             for r in numpy.linspace(1E-3, 0.8, 5):
                 lsst.meas.multifit.solveTrustRegion(x, f, g, r, tolerance)
                 self.assertLessEqual(numpy.linalg.norm(x), r * (1.0 + tolerance))
+        # finally, check that the fixed-size and dynamic-size implementations agree, by embedding
+        # the same problem in a matrix too large for the fixed-size specializations
+        log.info("Testing solveTrustRegion with fixed-size and dynamic-size matrices")
+        m = numpy.random.randn(30, 5)
+        y = numpy.random.randn(30)
+        f = numpy.dot(m.transpose(), m)
+        g = numpy.dot(m.transpose(), y)
+        fBig = numpy.identity(20)
+        fBig[:5,:5] = f
+        gBig = numpy.zeros(20)
+        gBig[:5] = g
+        xBig = numpy.zeros(20)
+        for r in numpy.linspace(1E-3, 0.8, 5):
+            lsst.meas.multifit.solveTrustRegion(x, f, g, r, tolerance)
+            lsst.meas.multifit.solveTrustRegion(xBig, fBig, gBig, r, tolerance)
+            self.assertClose(x, xBig[:5], rtol=1E-8, atol=1E-12)
+            self.assertClose(xBig[5:], 0.0, atol=1E-12)
+        # check that reusing a decomposition with TrustRegionSolver gives the same answers
+        log.info("Testing TrustRegionSolver against solveTrustRegion")
+        for fTest, gTest in [(f, g), (fBig, gBig)]:
+            solver = lsst.meas.multifit.TrustRegionSolver()
+            solver.setMatrix(fTest)
+            x1 = numpy.zeros(gTest.size)
+            x2 = numpy.zeros(gTest.size)
+            for r in numpy.linspace(0.8, 1E-3, 5):
+                lsst.meas.multifit.solveTrustRegion(x1, fTest, gTest, r, tolerance)
+                solver.solve(x2, gTest, r, tolerance)
+                self.assertClose(x1, x2, rtol=1E-10, atol=1E-14)
+
+    def testSteihaugSolver(self):
+        tolerance = 1E-10
+        m = numpy.random.randn(30, 5)
+        y = numpy.random.randn(30)
+        h = numpy.identity(5) * 0.1
+        f = numpy.dot(m.transpose(), m) + h
+        g = numpy.dot(m.transpose(), y)
+        empty = numpy.zeros((0, 5), dtype=float)
+        solver = lsst.meas.multifit.SteihaugSolver()
+        x1 = numpy.zeros(5)
+        x2 = numpy.zeros(5)
+        # with a large trust region and a positive-definite matrix, CG should converge to the exact solution
+        log.info("Testing SteihaugSolver with an unconstrained solution")
+        xExact = -numpy.linalg.solve(f, g)
+        r = 10.0 * numpy.linalg.norm(xExact)
+        solver.solve(x1, f, empty, g, r, tolerance)
+        self.assertClose(x1, xExact, rtol=1E-6)
+        self.assertLessEqual(solver.getIterations(), 5)
+        # passing J^T J implicitly should give the same answer as passing it explicitly
+        solver.solve(x2, h, m, g, r, tolerance)
+        self.assertClose(x1, x2, rtol=1E-8)
+        # constrained solutions should lie on the boundary, and never reduce the model less than
+        # the Cauchy point does (Nocedal and Wright Lemma 4.3)
+        log.info("Testing SteihaugSolver with constrained solutions")
+        for fTest in [f, m[:5,:] + m[:5,:].transpose()]:
+            for r in numpy.linspace(1E-3, 0.8, 5):
+                solver.solve(x1, fTest, empty, g, r, tolerance)
+                self.assertLessEqual(numpy.linalg.norm(x1), r * (1.0 + 1E-8))
+                gfg = numpy.dot(g, numpy.dot(fTest, g))
+                tau = 1.0
+                if gfg > 0.0:
+                    tau = min(numpy.linalg.norm(g)**3 / (r * gfg), 1.0)
+                xCauchy = -tau * r * g / numpy.linalg.norm(g)
+                model = lambda x: numpy.dot(g, x) + 0.5*numpy.dot(x, numpy.dot(fTest, x))
+                self.assertLessEqual(model(x1), model(xCauchy) + 1E-12)
+
+    def testVariableProjection(self):
+        problem = ToyProblem()
+        likelihood = problem.likelihood
+        nlDim = likelihood.getNonlinearDim()
+        objective = lsst.meas.multifit.VariableProjectionOptimizerObjective(likelihood)
+        nonlinear = problem.makeStart(0.1)[:nlDim]
+        # without a prior, the amplitudes should be the linear least-squares solution
+        amplitudes = numpy.zeros(likelihood.getAmplitudeDim(), dtype=lsst.meas.multifit.Scalar)
+        objective.computeAmplitudes(nonlinear, amplitudes)
+        modelMatrix = numpy.zeros((likelihood.getDataDim(), likelihood.getAmplitudeDim()),
+                                  dtype=lsst.meas.multifit.Pixel)
+        likelihood.computeModelMatrix(modelMatrix, nonlinear)
+        expected = numpy.linalg.lstsq(modelMatrix.astype(lsst.meas.multifit.Scalar),
+                                      likelihood.getData().astype(lsst.meas.multifit.Scalar))[0]
+        self.assertClose(amplitudes, expected, rtol=1E-6)
+        # the gradient the optimizer computes for the projected objective should agree with central
+        # differences of the projected objective value...
+        ctrl = lsst.meas.multifit.OptimizerControl()
+        ctrl.numDiffRelStep = 0.0
+        ctrl.numDiffTrustRadiusStep = 0.0
+        ctrl.numDiffAbsStep = 1E-4
+        residuals = numpy.zeros(likelihood.getDataDim(), dtype=lsst.meas.multifit.Scalar)
+        def computeObjective(x):
+            objective.computeResiduals(x, residuals)
+            return 0.5*numpy.dot(residuals, residuals)
+        expected = numpy.zeros(nlDim, dtype=lsst.meas.multifit.Scalar)
+        step = 1E-3
+        for k in range(nlDim):
+            x = nonlinear.copy()
+            x[k] += step
+            expected[k] = computeObjective(x)
+            x[k] -= 2*step
+            expected[k] -= computeObjective(x)
+            expected[k] /= 2*step
+        projected = lsst.meas.multifit.Optimizer(objective, nonlinear, ctrl)
+        self.assertClose(projected.getGradient(), expected, rtol=1E-2, atol=1E-3*numpy.abs(expected).max())
+        # ...and with the nonlinear part of the full objective's gradient at the projected amplitudes
+        fullObjective = lsst.meas.multifit.OptimizerObjective.makeFromLikelihood(likelihood)
+        full = lsst.meas.multifit.Optimizer(fullObjective, numpy.concatenate([nonlinear, amplitudes]), ctrl)
+        self.assertClose(projected.getGradient(), full.getGradient()[:nlDim], rtol=1E-2,
+                         atol=1E-3*numpy.abs(expected).max())
+
+    def testStatistics(self):
+        problem = ToyProblem()
+        for doUseResidualDerivatives in (False, True):
+            ctrl = lsst.meas.multifit.OptimizerControl()
+            ctrl.doUseResidualDerivatives = doUseResidualDerivatives
+            optimizer = lsst.meas.multifit.Optimizer(problem.makeObjective(), problem.makeStart(0.1), ctrl)
+            optimizer.run()
+            stats = optimizer.getStatistics()
+            self.assertGreater(stats.outerIterations, 0)
+            self.assertGreaterEqual(stats.innerIterations, stats.outerIterations - 1)
+            self.assertGreater(stats.jacobianEvaluations, 0)
+            # one evaluation at the start point, one per trial step, and one per nonlinear parameter
+            # for each (finite-difference) Jacobian, whether the Optimizer or the objective computes it
+            self.assertEqual(stats.residualEvaluations,
+                             1 + stats.innerIterations + stats.jacobianEvaluations*problem.nonlinearDim)
+            self.assertGreater(stats.modelTime, 0.0)
+            self.assertGreater(stats.priorTime, 0.0)
+            self.assertGreater(stats.trustRegionTime, 0.0)
+
+    def testBroydenUpdates(self):
+        problem = ToyProblem()
+        ctrl = lsst.meas.multifit.OptimizerControl()
+        full = lsst.meas.multifit.Optimizer(problem.makeObjective(), problem.makeStart(0.1), ctrl)
+        full.run()
+        self.assertFalse(full.getState() & lsst.meas.multifit.Optimizer.FAILED)
+        self.assertEqual(full.getStatistics().broydenUpdates, 0)
+        ctrl.jacobianRefreshInterval = 4
+        broyden = lsst.meas.multifit.Optimizer(problem.makeObjective(), problem.makeStart(0.1), ctrl)
+        broyden.run()
+        self.assertFalse(broyden.getState() & lsst.meas.multifit.Optimizer.FAILED)
+        # an approximate Jacobian changes the path, but not the point we converge to
+        self.assertClose(broyden.getParameters(), full.getParameters(), rtol=1E-3, atol=1E-4)
+        self.assertGreater(broyden.getStatistics().broydenUpdates, 0)
+        self.assertLess(broyden.getStatistics().jacobianEvaluations, full.getStatistics().jacobianEvaluations)
+
+    def testOptimizerReset(self):
+        problem = ToyProblem()
+        ctrl = lsst.meas.multifit.OptimizerControl()
+        fresh = lsst.meas.multifit.Optimizer(problem.makeObjective(), problem.makeStart(0.1), ctrl)
+        fresh.run()
+        # an optimizer that has already run on a different problem and start point should give exactly
+        # the same result after reset() as a new one, with its statistics starting over from zero
+        other = ToyProblem(noiseSigma=0.05)
+        reused = lsst.meas.multifit.Optimizer(other.makeObjective(), other.makeStart(-0.2), ctrl)
+        reused.run()
+        reused.reset(problem.makeObjective(), problem.makeStart(0.1))
+        reused.run()
+        self.assertEqual(reused.getState(), fresh.getState())
+        self.assertClose(reused.getParameters(), fresh.getParameters(), rtol=1E-12)
+        self.assertClose(reused.getObjectiveValue(), fresh.getObjectiveValue(), rtol=1E-12)
+        self.assertEqual(reused.getStatistics().outerIterations, fresh.getStatistics().outerIterations)
+        self.assertEqual(reused.getStatistics().residualEvaluations,
+                         fresh.getStatistics().residualEvaluations)
+        # the same should hold for a warm start
+        hessian = fresh.getHessian().copy()
+        trustRadius = fresh.getTrustRadius()
+        warm = lsst.meas.multifit.Optimizer(problem.makeObjective(), problem.makeStart(0.05), ctrl,
+                                            hessian, trustRadius)
+        warm.run()
+        reused.reset(problem.makeObjective(), problem.makeStart(0.05), hessian, trustRadius)
+        reused.run()
+        self.assertEqual(reused.getState(), warm.getState())
+        self.assertClose(reused.getParameters(), warm.getParameters(), rtol=1E-12)
+        self.assertClose(reused.getObjectiveValue(), warm.getObjectiveValue(), rtol=1E-12)
+
+    def testWarmStart(self):
+        problem = ToyProblem()
+        ctrl = lsst.meas.multifit.OptimizerControl()
+        cold = lsst.meas.multifit.Optimizer(problem.makeObjective(), problem.makeStart(0.1), ctrl)
+        cold.run()
+        self.assertFalse(cold.getState() & lsst.meas.multifit.Optimizer.FAILED)
+        hessian = cold.getHessian().copy()
+        start = cold.getParameters().copy()
+        start[:problem.nonlinearDim] += 0.01
+        trustRadius = 0.05
+        for noSR1Term in (False, True):
+            ctrl.noSR1Term = noSR1Term
+            warm = lsst.meas.multifit.Optimizer(problem.makeObjective(), start, ctrl, hessian, trustRadius)
+            # the optimizer should start with exactly the Hessian and trust radius we gave it...
+            self.assertClose(warm.getHessian(), hessian, rtol=1E-12, atol=1E-12*numpy.abs(hessian).max())
+            self.assertEqual(warm.getTrustRadius(), trustRadius)
+            # ...and should still converge to the same point
+            warm.run()
+            self.assertFalse(warm.getState() & lsst.meas.multifit.Optimizer.FAILED)
+            self.assertClose(warm.getParameters(), cold.getParameters(), rtol=1E-3, atol=1E-4)
+        # an empty Hessian and nonpositive trust radius mean a cold start
+        ctrl.noSR1Term = False
+        empty = numpy.zeros((0, 0), dtype=lsst.meas.multifit.Scalar)
+        fallback = lsst.meas.multifit.Optimizer(problem.makeObjective(), start, ctrl, empty, 0.0)
+        reference = lsst.meas.multifit.Optimizer(problem.makeObjective(), start, ctrl)
+        self.assertClose(fallback.getHessian(), reference.getHessian(), rtol=1E-12)
+        self.assertEqual(fallback.getTrustRadius(), ctrl.trustRegionInitialSize)
+
+    def testBatchOptimizer(self):
+        ctrl = lsst.meas.multifit.OptimizerControl()
+        offsets = [0.05, -0.1, 0.2]
+        # each problem gets its own likelihood and prior, so they can safely be stepped concurrently
+        problems = [ToyProblem() for offset in offsets]
+        expected = []
+        for problem, offset in zip(problems, offsets):
+            optimizer = lsst.meas.multifit.Optimizer(problem.makeObjective(), problem.makeStart(offset), ctrl)
+            optimizer.run()
+            expected.append(optimizer)
+        # a problem whose prior has the wrong dimension throws as soon as its derivatives are evaluated;
+        # negative amplitudes make the MixturePrior skip the Mixture when evaluating the prior itself,
+        # so the exception comes from the Optimizer constructor rather than its argument checks
+        broken = ToyProblem()
+        component = lsst.meas.multifit.Mixture.Component(1.0, numpy.zeros(1), numpy.identity(1))
+        components = lsst.meas.multifit.Mixture.ComponentList()
+        components.append(component)
+        brokenPrior = lsst.meas.multifit.MixturePrior(lsst.meas.multifit.Mixture(1, components))
+        brokenObjective = lsst.meas.multifit.OptimizerObjective.makeFromLikelihood(broken.likelihood,
+                                                                                   brokenPrior)
+        brokenStart = broken.makeStart(0.0)
+        brokenStart[broken.nonlinearDim:] = -1.0
+        for nThreads in (1, 2):
+            batch = lsst.meas.multifit.BatchOptimizer(problems[0].truth.size, ctrl, nThreads)
+            indices = [batch.add(problem.makeObjective(), problem.makeStart(offset))
+                       for problem, offset in zip(problems[:1], offsets[:1])]
+            brokenIndex = batch.add(brokenObjective, brokenStart)
+            indices.extend(batch.add(problem.makeObjective(), problem.makeStart(offset))
+                           for problem, offset in zip(problems[1:], offsets[1:]))
+            self.assertEqual(batch.getSize(), len(offsets) + 1)
+            batch.run()
+            self.assertEqual(batch.getActiveCount(), 0)
+            states = batch.getStates()
+            self.assertEqual(states[brokenIndex], lsst.meas.multifit.Optimizer.FAILED_EXCEPTION)
+            self.assertTrue(numpy.isnan(batch.getObjectiveValues()[brokenIndex]))
+            self.assertTrue(numpy.isnan(batch.getParameters()[brokenIndex]).all())
+            self.assertRaises(lsst.pex.exceptions.LsstCppException, batch.getOptimizer, brokenIndex)
+            # the other problems should end up exactly where they do when run serially
+            for index, optimizer in zip(indices, expected):
+                self.assertEqual(states[index], optimizer.getState())
+                self.assertClose(batch.getParameters()[index], optimizer.getParameters(), rtol=1E-12)
+                self.assertClose(batch.getObjectiveValues()[index], optimizer.getObjectiveValue(), rtol=1E-12)
+                self.assertEqual(batch.getOptimizer(index).getState(), optimizer.getState())
+        # mismatched sizes are the caller's mistake, and are not turned into a failed problem
+        self.assertRaises(lsst.pex.exceptions.LsstCppException, batch.add,
+                          problems[0].makeObjective(), problems[0].truth[:-1].copy())
+
+    def testMultiStartOptimizer(self):
+        problem = ToyProblem()
+        ctrl = lsst.meas.multifit.OptimizerControl()
+        offsets = [0.1, -0.05, 0.4]
+        multiStart = lsst.meas.multifit.MultiStartOptimizer(problem.truth.size, ctrl, 1.0)
+        for offset in offsets:
+            multiStart.add(problem.makeObjective(), problem.makeStart(offset))
+        self.assertEqual(multiStart.getSize(), len(offsets))
+        self.assertRaises(lsst.pex.exceptions.LsstCppException, multiStart.getBest)
+        bestIndex = multiStart.run()
+        self.assertEqual(bestIndex, multiStart.getBestIndex())
+        # the start furthest from the truth is still far behind after the first step, so it should be
+        # abandoned, and should not be the best
+        self.assertTrue(multiStart.isAbandoned(2))
+        self.assertGreaterEqual(multiStart.getAbandonedCount(), 1)
+        self.assertNotEqual(bestIndex, 2)
+        # the best start should be the one with the lowest objective value among those that ran to the
+        # end, and should match a standalone run from the same starting point
+        best = multiStart.getBest()
+        self.assertFalse(best.getState() & lsst.meas.multifit.Optimizer.FAILED)
+        for index in range(len(offsets)):
+            if not multiStart.isAbandoned(index):
+                self.assertLessEqual(best.getObjectiveValue(),
+                                     multiStart.getOptimizer(index).getObjectiveValue())
+        serial = lsst.meas.multifit.Optimizer(problem.makeObjective(), problem.makeStart(offsets[bestIndex]),
+                                              ctrl)
+        serial.run()
+        self.assertClose(best.getParameters(), serial.getParameters(), rtol=1E-12)
+        self.assertClose(best.getParameters(), problem.truth, rtol=1E-3, atol=1E-3)
 
 def suite():
     """Returns a suite containing all the test cases in this module."""
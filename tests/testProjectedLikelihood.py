@@ -26,6 +26,7 @@ import unittest
 import numpy
 
 import lsst.pex.logging
+import lsst.pex.exceptions
 import lsst.utils.tests
 import lsst.shapelet.tests
 import lsst.afw.geom.ellipses
@@ -241,6 +242,394 @@ class UnitTransformedLikelihoodTestCase(lsst.utils.tests.TestCase):
                                                      efv, ctrl)
         self.checkLikelihood(l1d, data)
 
+    def testModelMatrixDerivatives(self):
+        """Test that model matrix derivatives agree with central differences of the model matrix.
+        """
+        exposure1 = lsst.afw.image.ExposureF(self.bbox1)
+        exposure1.setWcs(self.sys1.wcs)
+        exposure1.setCalib(self.sys1.calib)
+        exposure1.getMaskedImage().getVariance().set(1.0)
+        ctrl = lsst.meas.multifit.UnitTransformedLikelihoodControl()
+        likelihood = lsst.meas.multifit.UnitTransformedLikelihood(
+            self.model, self.fixed, self.sys0, self.position, exposure1, self.footprint1, self.psf1, ctrl
+            )
+        nlDim = likelihood.getNonlinearDim()
+        ampDim = likelihood.getAmplitudeDim()
+        dataDim = likelihood.getDataDim()
+        derivatives = numpy.zeros((nlDim, ampDim, dataDim), dtype=lsst.meas.multifit.Pixel)
+        likelihood.computeModelMatrixDerivatives(derivatives, self.nonlinear)
+        matrix1 = numpy.zeros((ampDim, dataDim), dtype=lsst.meas.multifit.Pixel).transpose()
+        matrix2 = numpy.zeros((ampDim, dataDim), dtype=lsst.meas.multifit.Pixel).transpose()
+        for k in range(nlDim):
+            step = 1E-2 * max(abs(self.nonlinear[k]), 1.0)
+            nonlinear = self.nonlinear.copy()
+            nonlinear[k] += step
+            likelihood.computeModelMatrix(matrix1, nonlinear)
+            nonlinear[k] -= 2*step
+            likelihood.computeModelMatrix(matrix2, nonlinear)
+            expected = (matrix1 - matrix2).transpose() / (2*step)
+            self.assertClose(derivatives[k], expected, rtol=1E-2, atol=1E-2*numpy.abs(expected).max(),
+                             **ASSERT_CLOSE_KWDS)
+        # passing in the model matrix at the unperturbed point should just save evaluating it again
+        likelihood.computeModelMatrix(matrix1, self.nonlinear)
+        reused = numpy.zeros((nlDim, ampDim, dataDim), dtype=lsst.meas.multifit.Pixel)
+        likelihood.computeModelMatrixDerivatives(reused, self.nonlinear, True, matrix1)
+        self.assertClose(reused, derivatives, rtol=1E-6, atol=1E-6*numpy.abs(derivatives).max())
+
+    def testObjectiveValueGrid(self):
+        """Test that threaded evaluation of objective grids agrees with serial evaluation.
+        """
+        exposure1 = lsst.afw.image.ExposureF(self.bbox1)
+        exposure1.setWcs(self.sys1.wcs)
+        exposure1.setCalib(self.sys1.calib)
+        exposure1.getMaskedImage().getVariance().set(1.0)
+        ctrl = lsst.meas.multifit.UnitTransformedLikelihoodControl()
+        likelihood = lsst.meas.multifit.UnitTransformedLikelihood(
+            self.model, self.fixed, self.sys0, self.position, exposure1, self.footprint1, self.psf1, ctrl
+            )
+        objective = lsst.meas.multifit.OptimizerObjective.makeFromLikelihood(likelihood)
+        parameters = numpy.concatenate([self.nonlinear, self.amplitudes])
+        grid = parameters + 0.05*numpy.random.randn(37, parameters.size)
+        # the grid is evaluated a few points at a time with computeResidualsBatch, which should agree
+        # with evaluating the residuals one point at a time
+        residuals = numpy.zeros((grid.shape[0], likelihood.getDataDim()), dtype=lsst.meas.multifit.Scalar)
+        for i in range(grid.shape[0]):
+            objective.computeResiduals(grid[i], residuals[i])
+        batchResiduals = numpy.zeros(residuals.shape, dtype=lsst.meas.multifit.Scalar)
+        objective.computeResidualsBatch(grid, batchResiduals)
+        self.assertClose(batchResiduals, residuals, rtol=1E-6, atol=1E-6*numpy.abs(residuals).max())
+        expected = numpy.zeros(grid.shape[0], dtype=lsst.meas.multifit.Scalar)
+        objective.fillObjectiveValueGrid(grid, expected)
+        self.assertClose(expected, 0.5*(residuals**2).sum(axis=1), rtol=1E-5)
+        for nThreads in (1, 4):
+            output = numpy.zeros(grid.shape[0], dtype=lsst.meas.multifit.Scalar)
+            chiSquared = numpy.zeros(grid.shape[0], dtype=lsst.meas.multifit.Scalar)
+            priorTerms = numpy.ones(grid.shape[0], dtype=lsst.meas.multifit.Scalar)
+            objective.fillObjectiveValueGrid(grid, output, chiSquared, priorTerms, nThreads)
+            self.assertClose(output, expected, rtol=1E-12)
+            self.assertClose(chiSquared, expected, rtol=1E-12)
+            self.assertClose(priorTerms, 0.0, atol=0.0)
+
+    def testModelCache(self):
+        """Test that an objective with a model cache gives the same residuals as one without, and
+        that it counts hits and misses correctly.
+        """
+        exposure1 = lsst.afw.image.ExposureF(self.bbox1)
+        exposure1.setWcs(self.sys1.wcs)
+        exposure1.setCalib(self.sys1.calib)
+        exposure1.getMaskedImage().getVariance().set(1.0)
+        ctrl = lsst.meas.multifit.UnitTransformedLikelihoodControl()
+        likelihood = lsst.meas.multifit.UnitTransformedLikelihood(
+            self.model, self.fixed, self.sys0, self.position, exposure1, self.footprint1, self.psf1, ctrl
+            )
+        uncached = lsst.meas.multifit.OptimizerObjective.makeFromLikelihood(likelihood)
+        cached = lsst.meas.multifit.OptimizerObjective.makeFromLikelihood(likelihood, None, 3)
+        nlDim = likelihood.getNonlinearDim()
+        parameters = numpy.concatenate([self.nonlinear, self.amplitudes])
+        points = parameters + 0.05*numpy.random.randn(3, parameters.size)
+        # revisit each point, then change only the amplitudes of the first
+        sequence = [points[0], points[1], points[2], points[0], points[2], points[1], points[0].copy()]
+        sequence[-1][nlDim:] *= 2.0
+        expected = numpy.zeros(likelihood.getDataDim(), dtype=lsst.meas.multifit.Scalar)
+        residuals = numpy.zeros(likelihood.getDataDim(), dtype=lsst.meas.multifit.Scalar)
+        for p in sequence:
+            uncached.computeResiduals(p, expected)
+            cached.computeResiduals(p, residuals)
+            self.assertClose(residuals, expected, rtol=1E-12)
+        self.assertEqual(cached.getModelCacheMisses(), 3)
+        self.assertEqual(cached.getModelCacheHits(), 4)
+
+    def testMultiEpoch(self):
+        """Test that multi-epoch likelihoods concatenate their epochs, and that evaluating epochs in
+        parallel (and in chunks) gives the same model matrix as serial evaluation.
+        """
+        exposure1 = lsst.afw.image.ExposureF(self.bbox1)
+        addGaussian(exposure1, self.ellipse.transform(self.t01.geometric), self.flux * self.t01.flux,
+                    psf=self.psf1)
+        exposure1.setWcs(self.sys1.wcs)
+        exposure1.setCalib(self.sys1.calib)
+        exposure1.getMaskedImage().getVariance().set(1.0)
+        efv = lsst.meas.multifit.EpochFootprintVector()
+        efv.push_back(lsst.meas.multifit.EpochFootprint(self.footprint0, self.exposure0, self.psf0))
+        efv.push_back(lsst.meas.multifit.EpochFootprint(self.footprint1, exposure1, self.psf1))
+        ctrl = lsst.meas.multifit.UnitTransformedLikelihoodControl()
+        serial = lsst.meas.multifit.UnitTransformedLikelihood(self.model, self.fixed, self.sys0,
+                                                             self.position, efv, ctrl)
+        data = numpy.concatenate([self.exposure0.getMaskedImage().getImage().getArray().flatten(),
+                                  exposure1.getMaskedImage().getImage().getArray().flatten()])
+        self.checkLikelihood(serial, data)
+        ctrl.nThreads = 3
+        ctrl.maxChunkPixels = 1000
+        threaded = lsst.meas.multifit.UnitTransformedLikelihood(self.model, self.fixed, self.sys0,
+                                                               self.position, efv, ctrl)
+        self.assertClose(threaded.getData(), serial.getData(), rtol=0.0, atol=0.0)
+        shape = (serial.getAmplitudeDim(), serial.getDataDim())
+        expected = numpy.zeros(shape, dtype=lsst.meas.multifit.Pixel).transpose()
+        matrix = numpy.zeros(shape, dtype=lsst.meas.multifit.Pixel).transpose()
+        serial.computeModelMatrix(expected, self.nonlinear)
+        threaded.computeModelMatrix(matrix, self.nonlinear)
+        self.assertClose(matrix, expected, rtol=1E-6, atol=1E-7, **ASSERT_CLOSE_KWDS)
+
+    def testTruncation(self):
+        """Test that skipping negligible components on chunks of the footprint does not change the model
+        matrix or its derivatives by more than the truncation tolerance.
+        """
+        ctrl = lsst.meas.multifit.UnitTransformedLikelihoodControl()
+        ctrl.maxChunkPixels = 500
+        full = lsst.meas.multifit.UnitTransformedLikelihood(self.model, self.fixed, self.sys0, self.position,
+                                                           self.exposure0, self.footprint0, self.psf0, ctrl)
+        ctrl.truncationTolerance = 1E-8
+        truncated = lsst.meas.multifit.UnitTransformedLikelihood(self.model, self.fixed, self.sys0,
+                                                                self.position, self.exposure0,
+                                                                self.footprint0, self.psf0, ctrl)
+        shape = (full.getAmplitudeDim(), full.getDataDim())
+        expected = numpy.zeros(shape, dtype=lsst.meas.multifit.Pixel).transpose()
+        matrix = numpy.zeros(shape, dtype=lsst.meas.multifit.Pixel).transpose()
+        full.computeModelMatrix(expected, self.nonlinear)
+        truncated.computeModelMatrix(matrix, self.nonlinear)
+        self.assertClose(matrix, expected, rtol=0.0, atol=1E-8*numpy.abs(expected).max(),
+                         **ASSERT_CLOSE_KWDS)
+        nlDim = full.getNonlinearDim()
+        expected = numpy.zeros((nlDim,) + shape, dtype=lsst.meas.multifit.Pixel)
+        derivatives = numpy.zeros((nlDim,) + shape, dtype=lsst.meas.multifit.Pixel)
+        full.computeModelMatrixDerivatives(expected, self.nonlinear)
+        truncated.computeModelMatrixDerivatives(derivatives, self.nonlinear)
+        self.assertClose(derivatives, expected, rtol=0.0, atol=1E-4*numpy.abs(expected).max())
+
+    def testTruncationDefaultChunking(self):
+        """Test that components are skipped on parts of the footprint far from the object even when
+        epochs are not chunked for threading.
+        """
+        ctrl = lsst.meas.multifit.UnitTransformedLikelihoodControl()
+        self.assertEqual(ctrl.maxChunkPixels, 0)
+        full = lsst.meas.multifit.UnitTransformedLikelihood(self.model, self.fixed, self.sys0, self.position,
+                                                           self.exposure0, self.footprint0, self.psf0, ctrl)
+        ctrl.truncationTolerance = 1E-8
+        truncated = lsst.meas.multifit.UnitTransformedLikelihood(self.model, self.fixed, self.sys0,
+                                                                self.position, self.exposure0,
+                                                                self.footprint0, self.psf0, ctrl)
+        shape = (full.getAmplitudeDim(), full.getDataDim())
+        expected = numpy.zeros(shape, dtype=lsst.meas.multifit.Pixel).transpose()
+        matrix = numpy.zeros(shape, dtype=lsst.meas.multifit.Pixel).transpose()
+        full.computeModelMatrix(expected, self.nonlinear)
+        truncated.computeModelMatrix(matrix, self.nonlinear)
+        self.assertClose(matrix, expected, rtol=0.0, atol=1E-8*numpy.abs(expected).max(),
+                         **ASSERT_CLOSE_KWDS)
+        # skipped terms leave exact zeros where the untruncated model is small but nonzero
+        self.assertGreater((matrix == 0.0).sum(), (expected == 0.0).sum())
+
+    def testBadPixels(self):
+        """Test that masked and invalid pixels are dropped when badMaskPlanes is set.
+        """
+        ctrl = lsst.meas.multifit.UnitTransformedLikelihoodControl()
+        full = lsst.meas.multifit.UnitTransformedLikelihood(self.model, self.fixed, self.sys0, self.position,
+                                                           self.exposure0, self.footprint0, self.psf0, ctrl)
+        mi = self.exposure0.getMaskedImage()
+        bad = mi.getMask().getPlaneBitMask("BAD")
+        good = numpy.ones(mi.getImage().getArray().shape, dtype=bool)
+        mi.getMask().getArray()[95:105,:20] |= bad
+        good[95:105,:20] = False
+        mi.getImage().getArray()[10,10] = numpy.nan
+        good[10,10] = False
+        mi.getVariance().getArray()[20,30] = 0.0
+        good[20,30] = False
+        ctrl.badMaskPlanes = ["BAD"]
+        efv = lsst.meas.multifit.EpochFootprintVector()
+        efv.push_back(lsst.meas.multifit.EpochFootprint(self.footprint0, self.exposure0, self.psf0))
+        for likelihood in [
+            lsst.meas.multifit.UnitTransformedLikelihood(self.model, self.fixed, self.sys0, self.position,
+                                                         self.exposure0, self.footprint0, self.psf0, ctrl),
+            lsst.meas.multifit.UnitTransformedLikelihood(self.model, self.fixed, self.sys0, self.position,
+                                                         efv, ctrl),
+            ]:
+            self.assertEqual(likelihood.getDataDim(), good.sum())
+            self.assertClose(likelihood.getData(), full.getData()[good.flatten()], rtol=0.0, atol=0.0)
+            self.assertTrue(numpy.isfinite(likelihood.getWeights()).all())
+            expected = numpy.zeros((1, full.getDataDim()), dtype=lsst.meas.multifit.Pixel).transpose()
+            matrix = numpy.zeros((1, likelihood.getDataDim()), dtype=lsst.meas.multifit.Pixel).transpose()
+            full.computeModelMatrix(expected, self.nonlinear)
+            likelihood.computeModelMatrix(matrix, self.nonlinear)
+            self.assertClose(matrix, expected[good.flatten()], rtol=1E-6, atol=1E-7)
+
+    def testSuperpixels(self):
+        """Test that low signal-to-noise pixels are binned into superpixels that remain consistent
+        with the model.
+        """
+        ctrl = lsst.meas.multifit.UnitTransformedLikelihoodControl()
+        full = lsst.meas.multifit.UnitTransformedLikelihood(self.model, self.fixed, self.sys0, self.position,
+                                                           self.exposure0, self.footprint0, self.psf0, ctrl)
+        ctrl.superpixelSize = 4
+        ctrl.superpixelMaxSignalToNoise = 3.0
+        binned = lsst.meas.multifit.UnitTransformedLikelihood(
+            self.model, self.fixed, self.sys0, self.position, self.exposure0, self.footprint0, self.psf0, ctrl
+        )
+        nSuper, remainder = divmod(full.getDataDim() - binned.getDataDim(), 15)
+        self.assertGreater(nSuper, 0)
+        self.assertEqual(remainder, 0)
+        # superpixels go at the end, and have the variance of a mean of 16 unit-variance pixels
+        self.assertClose(binned.getWeights()[-nSuper:], 4.0, rtol=1E-6)
+        self.assertClose(binned.getWeights()[:-nSuper], 1.0, rtol=1E-6)
+        # the image is noise-free, so the chi^2 at the true parameters should be nearly zero, even though
+        # superpixel models are evaluated only at their centers
+        matrix = numpy.zeros((1, binned.getDataDim()), dtype=lsst.meas.multifit.Pixel).transpose()
+        binned.computeModelMatrix(matrix, self.nonlinear)
+        model = numpy.dot(matrix, self.amplitudes)
+        residuals = binned.getData() - model
+        self.assertLess(numpy.dot(residuals, residuals), 1E-2 * binned.getDataDim())
+        # the native-resolution pixels should be a subset of the unbinned ones
+        self.assertEqual(len(numpy.setdiff1d(binned.getData()[:-nSuper], full.getData())), 0)
+        # reproduce the binning: the footprint is the 201x201 box from (-100,-100), and superpixels are
+        # made from the blocks of a 4x4 grid aligned with the origin that lie entirely within it, in
+        # row-major block order
+        fullMatrix = numpy.zeros((1, full.getDataDim()), dtype=lsst.meas.multifit.Pixel).transpose()
+        full.computeModelMatrix(fullMatrix, self.nonlinear)
+        fullModel = numpy.dot(fullMatrix, self.amplitudes).reshape(201, 201)
+        fullData = full.getData().reshape(201, 201).astype(float)
+        isBinned = numpy.zeros((201, 201), dtype=bool)
+        expectedData = []
+        expectedModel = []
+        for by in range(-25, 25):
+            for bx in range(-25, 25):
+                block = (slice(4*by + 100, 4*by + 104), slice(4*bx + 100, 4*bx + 104))
+                if abs(fullData[block].sum()) >= 3.0 * 16**0.5:
+                    continue
+                isBinned[block] = True
+                expectedData.append(fullData[block].mean())
+                expectedModel.append(fullModel[block].mean())
+        self.assertEqual(len(expectedData), nSuper)
+        self.assertClose(binned.getData()[-nSuper:], numpy.array(expectedData), rtol=1E-5, atol=1E-7)
+        # native pixels are modeled exactly as before, with the original PSF...
+        self.assertClose(model[:-nSuper], fullModel[~isBinned], rtol=1E-5, atol=1E-7)
+        # ...while superpixels use a broadened PSF, so their model approximates the mean over each block
+        self.assertClose(model[-nSuper:], numpy.array(expectedModel), rtol=1E-2,
+                         atol=1E-4*numpy.abs(fullModel).max())
+
+    def testDownsample(self):
+        """Test that a downsampled likelihood averages the data in blocks and remains consistent with
+        the model.
+        """
+        ctrl = lsst.meas.multifit.UnitTransformedLikelihoodControl()
+        dropped = lsst.meas.multifit.UnitTransformedLikelihood(self.model, self.fixed, self.sys0,
+                                                              self.position, self.exposure0, self.footprint0,
+                                                              self.psf0, ctrl)
+        self.assertFalse(dropped.canDownsample())
+        self.assertRaises(lsst.pex.exceptions.LsstCppException,
+                          lsst.meas.multifit.UnitTransformedLikelihood, dropped, 2)
+        ctrl.keepUnbinnedPixels = True
+        full = lsst.meas.multifit.UnitTransformedLikelihood(self.model, self.fixed, self.sys0, self.position,
+                                                           self.exposure0, self.footprint0, self.psf0, ctrl)
+        self.assertTrue(full.canDownsample())
+        same = lsst.meas.multifit.UnitTransformedLikelihood(full, 1)
+        self.assertClose(same.getData(), full.getData(), rtol=0.0, atol=0.0)
+        self.assertClose(same.getWeights(), full.getWeights(), rtol=0.0, atol=0.0)
+        coarse = lsst.meas.multifit.UnitTransformedLikelihood(full, 2)
+        # the 201x201 footprint is split into 101x101 blocks, of which the last row and column are partial
+        self.assertEqual(coarse.getDataDim(), 101**2)
+        self.assertClose(numpy.sort(coarse.getWeights())[-100**2:], 2.0, rtol=1E-6)
+        fullMatrix = numpy.zeros((1, full.getDataDim()), dtype=lsst.meas.multifit.Pixel).transpose()
+        coarseMatrix = numpy.zeros((1, coarse.getDataDim()), dtype=lsst.meas.multifit.Pixel).transpose()
+        full.computeModelMatrix(fullMatrix, self.nonlinear)
+        coarse.computeModelMatrix(coarseMatrix, self.nonlinear)
+        # total flux is preserved, and the image is noise-free, so the model should match the data
+        self.assertClose((coarseMatrix[:,0] * coarse.getWeights()).sum(),
+                         (fullMatrix[:,0] * full.getWeights()).sum() / 4.0, rtol=1E-3)
+        residuals = coarse.getData() - numpy.dot(coarseMatrix, self.amplitudes)
+        self.assertLess(numpy.dot(residuals, residuals), 1E-4 * coarse.getDataDim())
+
+    def testModelMatrices(self):
+        """Test that evaluating a batch of model matrices at once agrees with evaluating them one at a time.
+        """
+        ctrl = lsst.meas.multifit.UnitTransformedLikelihoodControl()
+        ctrl.nThreads = 2
+        ctrl.maxChunkPixels = 5000
+        likelihood = lsst.meas.multifit.UnitTransformedLikelihood(
+            self.model, self.fixed, self.sys0, self.position, self.exposure0, self.footprint0, self.psf0, ctrl
+        )
+        nPoints = 4
+        points = numpy.zeros((nPoints, self.model.getNonlinearDim()), dtype=lsst.meas.multifit.Scalar)
+        for k in range(nPoints):
+            points[k,:] = self.nonlinear + 0.05*k
+        matrices = numpy.zeros((nPoints, likelihood.getAmplitudeDim(), likelihood.getDataDim()),
+                               dtype=lsst.meas.multifit.Pixel)
+        likelihood.computeModelMatrices(matrices, points)
+        for k in range(nPoints):
+            matrix = numpy.zeros((likelihood.getAmplitudeDim(), likelihood.getDataDim()),
+                                 dtype=lsst.meas.multifit.Pixel).transpose()
+            likelihood.computeModelMatrix(matrix, points[k])
+            self.assertClose(matrices[k].transpose(), matrix, rtol=0.0, atol=0.0)
+
+    def testTransformCache(self):
+        """Test that transforms built from cached Wcs linearizations agree with direct computation.
+        """
+        exact = lsst.meas.multifit.LocalUnitTransformCache(self.sys0, 0.0)
+        cached = lsst.meas.multifit.LocalUnitTransformCache(self.sys0, 64.0)
+        for dx, dy in [(0.0, 0.0), (3.0, -2.0), (50.0, 70.0), (-200.0, 10.0)]:
+            position = self.sys0.wcs.pixelToSky(lsst.afw.geom.Point2D(dx, dy))
+            for cache, rtol in [(exact, 1E-8), (cached, 1E-5)]:
+                for t1, t2 in [
+                    (cache.toSystem(position, self.sys1),
+                     lsst.meas.multifit.LocalUnitTransform(position, self.sys0, self.sys1)),
+                    (cache.fromSystem(position, self.sys1),
+                     lsst.meas.multifit.LocalUnitTransform(position, self.sys1, self.sys0)),
+                    ]:
+                    self.assertClose(t1.geometric.getLinear().getMatrix(),
+                                     t2.geometric.getLinear().getMatrix(), rtol=rtol)
+                    self.assertClose(t1.geometric.getTranslation().getX(),
+                                     t2.geometric.getTranslation().getX(), rtol=rtol, atol=1E-6)
+                    self.assertClose(t1.geometric.getTranslation().getY(),
+                                     t2.geometric.getTranslation().getY(), rtol=rtol, atol=1E-6)
+                    self.assertClose(t1.flux, t2.flux, rtol=1E-14)
+                    self.assertClose(t1.sb, t2.sb, rtol=rtol)
+        self.assertEqual(exact.getSize(), 0)
+        self.assertEqual(cached.getSize(), 4)
+
+    def testNormalEquations(self):
+        """Test that the normal equations accumulated one tile at a time agree with those computed
+        from the full model matrix, however the epochs are chunked for threading
+        (including chunks small enough to be used as tiles directly).
+        """
+        exposure1 = lsst.afw.image.ExposureF(self.bbox1)
+        addGaussian(exposure1, self.ellipse.transform(self.t01.geometric), self.flux * self.t01.flux,
+                    psf=self.psf1)
+        exposure1.setWcs(self.sys1.wcs)
+        exposure1.setCalib(self.sys1.calib)
+        exposure1.getMaskedImage().getVariance().set(1.0)
+        efv = lsst.meas.multifit.EpochFootprintVector()
+        efv.push_back(lsst.meas.multifit.EpochFootprint(self.footprint0, self.exposure0, self.psf0))
+        efv.push_back(lsst.meas.multifit.EpochFootprint(self.footprint1, exposure1, self.psf1))
+        ctrl = lsst.meas.multifit.UnitTransformedLikelihoodControl()
+        for nThreads, maxChunkPixels in [(1, 0), (3, 0), (3, 500), (3, 200)]:
+            ctrl.nThreads = nThreads
+            ctrl.maxChunkPixels = maxChunkPixels
+            likelihood = lsst.meas.multifit.UnitTransformedLikelihood(self.model, self.fixed, self.sys0,
+                                                                     self.position, efv, ctrl)
+            ampDim = likelihood.getAmplitudeDim()
+            matrix = numpy.zeros((ampDim, likelihood.getDataDim()), dtype=lsst.meas.multifit.Pixel)
+            likelihood.computeModelMatrix(matrix.transpose(), self.nonlinear)
+            matrix = matrix.transpose().astype(lsst.meas.multifit.Scalar)
+            data = likelihood.getData().astype(lsst.meas.multifit.Scalar)
+            hessian = numpy.zeros((ampDim, ampDim), dtype=lsst.meas.multifit.Scalar)
+            gradient = numpy.zeros(ampDim, dtype=lsst.meas.multifit.Scalar)
+            likelihood.computeNormalEquations(self.nonlinear, hessian, gradient)
+            self.assertClose(hessian, numpy.dot(matrix.transpose(), matrix), rtol=1E-10)
+            self.assertClose(gradient, numpy.dot(matrix.transpose(), data), rtol=1E-10)
+            # clones build their own tiles on first use
+            cloneHessian = numpy.zeros((ampDim, ampDim), dtype=lsst.meas.multifit.Scalar)
+            cloneGradient = numpy.zeros(ampDim, dtype=lsst.meas.multifit.Scalar)
+            likelihood.clone().computeNormalEquations(self.nonlinear, cloneHessian, cloneGradient)
+            self.assertClose(cloneHessian, hessian, rtol=1E-12)
+            self.assertClose(cloneGradient, gradient, rtol=1E-12)
+            # a batch of points gives the same results as one point at a time
+            points = numpy.array([self.nonlinear, self.nonlinear + 0.01, self.nonlinear - 0.01],
+                                 dtype=lsst.meas.multifit.Scalar)
+            hessians = numpy.zeros((len(points), ampDim, ampDim), dtype=lsst.meas.multifit.Scalar)
+            gradients = numpy.zeros((len(points), ampDim), dtype=lsst.meas.multifit.Scalar)
+            likelihood.computeNormalEquationsBatch(points, hessians, gradients)
+            for k, point in enumerate(points):
+                likelihood.computeNormalEquations(point, hessian, gradient)
+                self.assertClose(hessians[k], hessian, rtol=1E-12)
+                self.assertClose(gradients[k], gradient, rtol=1E-12)
+
 def suite():
     """Returns a suite containing all the test cases in this module."""
 
@@ -257,6 +257,21 @@ class PsfFitterTestCase(lsst.utils.tests.TestCase):
                                  atol=tolerances[configKey],
                                  plotOnFailure=True)
 
+    def testApplyThreaded(self):
+        """Test that computing numerical derivatives in multiple threads doesn't change the results."""
+        filename = glob.glob(os.path.join(DATA_DIR, "psfs", "*.fits"))[0]
+        kernelImage = lsst.afw.image.ImageD(filename)
+        shape = computeMoments(kernelImage)
+        results = []
+        for numDiffThreads in (1, 4):
+            self.configs['full'].optimizer.numDiffThreads = numDiffThreads
+            fitter = lsst.meas.multifit.PsfFitter(self.configs['full'].makeControl())
+            multiShapeletFit = fitter.apply(kernelImage, shape, 0.01)
+            modelImage = lsst.afw.image.ImageD(kernelImage.getBBox(lsst.afw.image.PARENT))
+            multiShapeletFit.evaluate().addToImage(modelImage)
+            results.append(modelImage.getArray())
+        self.assertClose(results[0], results[1], rtol=0.0, atol=0.0)
+
 def suite():
     """Returns a suite containing all the test cases in this module."""
 